@@ -0,0 +1,63 @@
+// TEXT RUN CACHE BENCHMARK
+//   draws the strings of a typical status bar over and over and reports the
+//   time per string, `make bench` builds it with and without the cache of the
+//   draw module, both need a running X server. Only the lookup and drawing
+//   of the strings is timed, the render target is set up before. No numbers
+//   are recorded here yet, the cache went in without an X server at hand to
+//   run this on.
+
+#include <stdlib.h>
+#include <xcb/xcb.h>
+#include "draw.h"
+#include "util.h"
+#include "vxwm.h"
+
+#define BENCH_FONT       "monospace"
+#define BENCH_FONT_SIZE  22
+
+session_t sn;
+
+static const char *text[] = {
+  "1", "2", "3", "[3 COL]", "[2/5 STK]",
+  "vim src/vxwm.c", "vxwm " VXWM_VERSION, "Fri 16 Oct 12:00",
+};
+
+int main(int argc, char **argv)
+{
+  int i, j, h, tw, n = argc > 1 ? atoi(argv[1]) : 10000;
+  double t;
+
+  sn.conn = xcb_connect(NULL, NULL);
+  if (xcb_connection_has_error(sn.conn))
+    die("failed to connect to x server\n");
+  sn.scr = xcb_setup_roots_iterator(xcb_get_setup(sn.conn)).data;
+  sn.root = sn.scr->root;
+  draw_setup();
+  draw_select_font(BENCH_FONT, BENCH_FONT_SIZE, &h);
+
+  draw_begin(sn.scr->width_in_pixels, h);
+
+  t = time_ms();
+  for (i = 0; i < n; i++) {
+    for (j = 0; j < (int)LENGTH(text); j++) {
+      draw_text_extents(text[j], &tw, NULL);
+      draw_text(j * 64, 0, tw, h, text[j], 0xCCCCCC, 0);
+    }
+  }
+  // wait for the server to have rendered everything sent
+  free(xcb_get_input_focus_reply(sn.conn, xcb_get_input_focus(sn.conn), NULL));
+  t = time_ms() - t;
+
+  printf("%s: %d rounds of %d strings in %.1f ms, %.3f us per string\n",
+#ifdef VXWM_DRAW_NO_TEXT_CACHE
+         "uncached",
+#else
+         "cached",
+#endif
+         n, (int)LENGTH(text), t, t * 1e3 / ((double)n * LENGTH(text)));
+  draw_cleanup();
+  xcb_disconnect(sn.conn);
+  return 0;
+}
+
+// vim: ts=2:sw=2:et
@@ -0,0 +1,55 @@
+// WINDOW MAP BENCHMARK
+//   fills the window map with N = 10 to 10000 windows and reports the time
+//   per lookup for each N, which should stay flat as the map grows, half of
+//   the lookups are for windows that are not mapped, needs no X server
+//
+//   gcc -O2 on x86-64, 10^7 lookups per size:
+//      10 windows   7.0 ns per lookup
+//     100 windows   7.4 ns per lookup
+//    1000 windows  10.8 ns per lookup  (map just under half full)
+//   10000 windows   8.4 ns per lookup
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "wmap.h"
+#include "util.h"
+
+#define BENCH_CLIENTS    32  // id ranges windows are spread over
+
+static xcb_window_t bench_window(int i);
+static const int size[] = { 10, 100, 1000, 10000 };
+
+// X hands each client a range of ids, windows of a range are numbered up
+INLINE
+xcb_window_t bench_window(int i)
+{
+  return (xcb_window_t)(0x200000 * (1 + i % BENCH_CLIENTS) + i / BENCH_CLIENTS + 1);
+}
+
+int main(int argc, char **argv)
+{
+  int i, j, k, n = argc > 1 ? atoi(argv[1]) : 10000000;
+  client_t *volatile sink;
+  double t;
+
+  for (i = 0; i < (int)LENGTH(size); i++) {
+    wmap_setup();
+    for (j = 0; j < size[i]; j++)
+      wmap_insert(bench_window(j), (client_t *)&size[i], RoleFrame, 0);
+    t = time_ms();
+    for (j = k = 0; j < n; j++) {
+      // hits step through the map, misses come from past the last window
+      sink = wmap_lookup(bench_window(j & 1 ? k : size[i] + k), RoleFrame, NULL);
+      if (++k == size[i])
+        k = 0;
+    }
+    t = time_ms() - t;
+    (void)sink;
+    printf("%5d windows: %d lookups in %.1f ms, %.2f ns per lookup\n",
+           size[i], n, t, t * 1e6 / n);
+    wmap_cleanup();
+  }
+  return 0;
+}
+
+// vim: ts=2:sw=2:et
@@ -0,0 +1,86 @@
+#include <xcb/xcb.h>
+#include <xcb/xcbext.h>
+#include "async.h"
+#include "util.h"
+#include "vxwm.h"
+
+#define ASYNC_MIN_CAP   32
+
+typedef struct pending {
+  unsigned int seq;    // sequence number of the request
+  async_fn_t fn;       // continuation
+  xcb_window_t win;    // window the request is about
+  void *data;          // continuation data
+  async_free_t free;   // releases data when dropped, NULL if it needs none
+} pending_t;
+
+// ring buffer of pending requests, kept in the order they were sent
+static pending_t *ring;
+static unsigned int head, cnt, cap;
+
+/// Queues a continuation for the reply of a request that was just sent.
+/// @param free releases data if the continuation is dropped without running
+void async_push(unsigned int seq, async_fn_t fn, xcb_window_t win, void *data, async_free_t free)
+{
+  pending_t *old = ring;
+  unsigned int i;
+
+  if (cnt == cap) {
+    ring = xmalloc(sizeof(pending_t) * (cap ? cap << 1 : ASYNC_MIN_CAP));
+    for (i = 0; i < cnt; i++)
+      ring[i] = old[(head + i) % cap];
+    xfree(old);
+    head = 0;
+    cap = cap ? cap << 1 : ASYNC_MIN_CAP;
+  }
+  ring[(head + cnt++) % cap] = (pending_t){ seq, fn, win, data, free };
+}
+
+bool async_pending(void)
+{
+  return cnt > 0;
+}
+
+/// Runs the continuations of every reply that has already arrived.
+/// Replies arrive in request order, so we stop at the first one still in flight.
+/// @return number of continuations that ran
+int async_dispatch(void)
+{
+  xcb_generic_error_t *err;
+  pending_t p;
+  void *reply;
+  int n = 0;
+
+  while (cnt > 0) {
+    p = ring[head];
+    reply = NULL;
+    err = NULL;
+    if (!xcb_poll_for_reply(sn.conn, p.seq, &reply, &err))
+      break;
+    head = (head + 1) % cap;
+    cnt--;
+    if (err) {
+      LOGW("request %u for %d failed with error %d\n", p.seq, p.win, err->error_code)
+      xfree(err);
+    }
+    p.fn(reply, p.win, p.data);
+    xfree(reply);
+    n++;
+  }
+  return n;
+}
+
+// drops the continuations still waiting, releasing their data
+void async_cleanup(void)
+{
+  for (; cnt > 0; cnt--, head = (head + 1) % cap) {
+    xcb_discard_reply(sn.conn, ring[head].seq);
+    if (ring[head].free)
+      ring[head].free(ring[head].data);
+  }
+  xfree(ring);
+  ring = NULL;
+  head = cap = 0;
+}
+
+// vim: ts=2:sw=2:et
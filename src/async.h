@@ -0,0 +1,22 @@
+#ifndef VXWM_ASYNC_H
+#define VXWM_ASYNC_H
+
+// ASYNCHRONOUS REPLIES
+//   queue request cookies together with continuations
+//   continuations run from the event loop once their reply has arrived
+
+#include <stdbool.h>
+#include <xcb/xproto.h>
+
+// reply is NULL if the request failed and is freed once the continuation returns,
+// data is passed through untouched and is owned by the continuation
+typedef void (*async_fn_t)(void *reply, xcb_window_t win, void *data);
+// releases the data of a continuation that never ran
+typedef void (*async_free_t)(void *data);
+
+void async_push(unsigned int, async_fn_t, xcb_window_t, void *, async_free_t);
+bool async_pending(void);
+int async_dispatch(void);
+void async_cleanup(void);
+
+#endif // VXWM_ASYNC_H
@@ -13,6 +13,8 @@
 #define VXWM_TAB_SELECT_CLR   0xFFA500
 #define VXWM_FONT             "monospace"
 #define VXWM_FONT_SIZE        22
+#define VXWM_TITLE_REFRESH_MS 5000 // background tab titles are refetched at most this often
+#define VXWM_FRAME_SPARE      8    // unmapped frames kept for reuse by new clients
 
 static page_t pages[] = {
   { "1", column, {  3, -1, -1 } },
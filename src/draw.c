@@ -1,4 +1,7 @@
+#include <sys/ipc.h>
+#include <sys/shm.h>
 #include <xcb/xproto.h>
+#include <xcb/shm.h>
 #include <cairo/cairo.h>
 #include <cairo/cairo-xcb.h>
 #include "draw.h"
@@ -10,17 +13,72 @@
 #define G256(color)     (color >> 8 & 255)
 #define B256(color)     (color & 255)
 #define D2R(deg)        (deg * M_PI / 180)
+#define PIXEL_BYTES(d)  ((d) > 16 ? 4 : (d) > 8 ? 2 : 1)
+#define TEXT_RUNS       64  // cached glyph runs, a power of two
+#define SHM_SLICES      4   // render targets per shared memory segment
+
+// a string shaped with the selected font, its glyphs laid out from the origin
+typedef struct {
+  char *text;             // cached string, NULL for an empty slot
+  size_t len;
+  uint32_t hash;
+  cairo_glyph_t *glyph;
+  int nglyph;
+  int advance, height;    // extents of the run
+} text_run_t;
+
+// A shared memory segment split into equally sized slices, each one a render
+// target with a cairo context of its own. A slice is drawn into again once the
+// server completed every image put from it, segments are added when all
+// slices are busy. Segments with slices too small for a target are retired,
+// then freed once the server is done with them.
+typedef struct shm_seg {
+  struct shm_seg *next;
+  xcb_shm_seg_t seg;
+  int id;                 // segment id, until marked for removal
+  uint8_t *addr;
+  int w, h;               // size of each slice
+  bool retired;
+  struct {
+    cairo_surface_t *surface;
+    cairo_t *cr;
+    int pending;          // puts the server has not completed yet
+  } slice[SHM_SLICES];
+} shm_seg_t;
 
 static xcb_visualtype_t *get_visual_type(xcb_screen_t *scr);
 static void draw_set_color(color_t clr);
 static void draw_set_line_width(double lw);
+static void draw_set_target(int w, int h);
+static void draw_set_context(void);
+static void pixmap_setup(int w, int h);
+static bool shm_setup(void);
+static shm_seg_t *shm_alloc(int w, int h, bool check);
+static void shm_free(shm_seg_t *sg);
+static void shm_release(void);
+static void shm_set_target(int w, int h);
+static void text_run_clear(text_run_t *r);
+static text_run_t *text_run(const char *text);
 static xcb_gcontext_t gc;
 static xcb_drawable_t pixmap;
+static int pixw, pixh;
 static cairo_surface_t *surface;
 static cairo_t *cr;
 static color_t source_clr;
 static double source_lw;
 static double font_height, font_descent;
+static text_run_t runs[TEXT_RUNS];
+static cairo_font_face_t *font_face;
+static double font_size;
+static bool shm;            // rendering client side into shared memory
+static int shm_event;       // response type of put completions
+static shm_seg_t *segs;     // shared segments, live ones first
+static shm_seg_t *cseg;     // segment and slice of the current target
+static int cslice;
+#ifdef VXWM_DEBUG
+static unsigned int nhit, nmiss;
+static double text_ms;
+#endif
 
 xcb_visualtype_t *get_visual_type(xcb_screen_t *scr)
 {
@@ -56,53 +114,327 @@ void draw_set_line_width(double lw)
   }
 }
 
-void draw_setup(void)
+// replaces the pixmap backing the surface, the cairo context and its state survive
+void draw_set_target(int w, int h)
 {
-  uint32_t scrw = sn.scr->width_in_pixels, scrh = sn.scr->height_in_pixels;
-  uint32_t val = 0;
-  xcb_visualtype_t *vt;
+  xcb_drawable_t old = pixmap;
 
-  // setup xcb graphics context and pixmap buffer
-  gc = xcb_generate_id(sn.conn);
-  xcb_create_gc(sn.conn, gc, sn.root, XCB_GC_GRAPHICS_EXPOSURES, &val);
   pixmap = xcb_generate_id(sn.conn);
-  xcb_create_pixmap(sn.conn, sn.scr->root_depth, pixmap, sn.root, scrw, scrh);
+  xcb_create_pixmap(sn.conn, sn.scr->root_depth, pixmap, sn.root, w, h);
+  if (surface) {
+    cairo_surface_flush(surface);
+    cairo_xcb_surface_set_drawable(surface, pixmap, w, h);
+    xcb_free_pixmap(sn.conn, old);
+  }
+  pixw = w;
+  pixh = h;
+  LOGI("render target %dx%d, %d bytes\n", w, h, w * h * PIXEL_BYTES(sn.scr->root_depth))
+}
 
-  // create cairo surface and context
+// Checks that images can be drawn client side and handed over in shared
+// memory: the server must support MIT-SHM and be able to attach a segment of
+// ours, which it cannot when remote, and the root depth must be stored in 32
+// bit pixels laid out like the cairo RGB24 format.
+bool shm_setup(void)
+{
+  const xcb_query_extension_reply_t *ext;
+  xcb_format_iterator_t fi;
+  xcb_visualtype_t *vt;
+  bool bpp32 = false;
+
+  ext = xcb_get_extension_data(sn.conn, &xcb_shm_id);
+  if (!ext || !ext->present)
+    return false;
+  fi = xcb_setup_pixmap_formats_iterator(xcb_get_setup(sn.conn));
+  for (; fi.rem; xcb_format_next(&fi))
+    if (fi.data->depth == sn.scr->root_depth)
+      bpp32 = fi.data->bits_per_pixel == 32;
   vt = get_visual_type(sn.scr);
-  surface = cairo_xcb_surface_create(sn.conn, pixmap, vt, scrw, scrh);
+  if (sn.scr->root_depth != 24 || !bpp32 || !vt || vt->red_mask != 0xff0000 ||
+      vt->green_mask != 0xff00 || vt->blue_mask != 0xff)
+    return false;
+  shm_event = ext->first_event + XCB_SHM_COMPLETION;
+  return (segs = shm_alloc(1, 1, true)) != NULL;
+}
+
+// Creates a segment of w by h slices. Only the first attach is checked, to
+// learn whether the server can use our memory at all, later segments are
+// marked for removal once their first put completes.
+shm_seg_t *shm_alloc(int w, int h, bool check)
+{
+  xcb_generic_error_t *err;
+  shm_seg_t *sg;
+  int i;
+
+  sg = xmalloc(sizeof(shm_seg_t));
+  sg->w = w;
+  sg->h = h;
+  sg->retired = false;
+  sg->next = NULL;
+  if ((sg->id = shmget(IPC_PRIVATE, (size_t)w * h * 4 * SHM_SLICES, IPC_CREAT | 0600)) < 0) {
+    xfree(sg);
+    return NULL;
+  }
+  if ((sg->addr = shmat(sg->id, NULL, 0)) == (void *)-1) {
+    shmctl(sg->id, IPC_RMID, NULL);
+    xfree(sg);
+    return NULL;
+  }
+  sg->seg = xcb_generate_id(sn.conn);
+  if (!check)
+    xcb_shm_attach(sn.conn, sg->seg, sg->id, false);
+  else if ((err = xcb_request_check(sn.conn, xcb_shm_attach_checked(sn.conn, sg->seg, sg->id, false)))) {
+    xfree(err);
+    shmctl(sg->id, IPC_RMID, NULL);
+    shmdt(sg->addr);
+    xfree(sg);
+    return NULL;
+  }
+  for (i = 0; i < SHM_SLICES; i++) {
+    sg->slice[i].surface = cairo_image_surface_create_for_data(sg->addr + (size_t)w * h * 4 * i,
+                                                               CAIRO_FORMAT_RGB24, w, h, w * 4);
+    if (cairo_surface_status(sg->slice[i].surface) != CAIRO_STATUS_SUCCESS)
+      die("failed to allocate surface on shared memory\n");
+    sg->slice[i].cr = cairo_create(sg->slice[i].surface);
+    if (font_face) {
+      cairo_set_font_face(sg->slice[i].cr, font_face);
+      cairo_set_font_size(sg->slice[i].cr, font_size);
+    }
+    sg->slice[i].pending = 0;
+  }
+  LOGI("shared render segment: %d slices of %dx%d, %zu bytes\n",
+       SHM_SLICES, w, h, (size_t)w * h * 4 * SHM_SLICES)
+  return sg;
+}
+
+// detaching is ordered after every put, so the server is done with the memory
+void shm_free(shm_seg_t *sg)
+{
+  int i;
+
+  for (i = 0; i < SHM_SLICES; i++) {
+    cairo_destroy(sg->slice[i].cr);
+    cairo_surface_destroy(sg->slice[i].surface);
+  }
+  xcb_shm_detach(sn.conn, sg->seg);
+  if (sg->id >= 0)
+    shmctl(sg->id, IPC_RMID, NULL);
+  shmdt(sg->addr);
+  xfree(sg);
+}
+
+// frees retired segments without pending puts, except the current one
+void shm_release(void)
+{
+  shm_seg_t **sp, *sg;
+  int i;
+
+  for (sp = &segs; (sg = *sp); ) {
+    for (i = 0; i < SHM_SLICES && sg->slice[i].pending == 0; i++) ;
+    if (sg->retired && sg != cseg && i == SHM_SLICES) {
+      *sp = sg->next;
+      shm_free(sg);
+    } else
+      sp = &sg->next;
+  }
+}
+
+// Picks a slice for the next drawing whose images the server has completed,
+// so the server never reads memory while it is drawn into, and nothing waits.
+void shm_set_target(int w, int h)
+{
+  shm_seg_t *sg;
+  int i = 0;
+
+  if (w > segs->w || h > segs->h) {
+    for (sg = segs; sg; sg = sg->next)
+      sg->retired = true;
+    w = MAX(w, segs->w);
+    h = MAX(h, segs->h);
+    sg = NULL;
+  } else
+    for (sg = segs; sg && !sg->retired; sg = sg->next) {
+      for (i = 0; i < SHM_SLICES && sg->slice[i].pending > 0; i++) ;
+      if (i < SHM_SLICES)
+        break;
+    }
+  if (!sg || sg->retired) {
+    if (!(sg = shm_alloc(w, h, false))) {
+      LOGW("failed to allocate shared memory, rendering into a pixmap\n")
+      shm = false;
+      cseg = NULL;
+      while ((sg = segs)) {
+        segs = sg->next;
+        shm_free(sg);
+      }
+      cr = NULL;
+      surface = NULL;
+      pixmap_setup(w, h);
+      return;
+    }
+    sg->next = segs;
+    segs = sg;
+    i = 0;
+  }
+  cseg = sg;
+  cslice = i;
+  shm_release();
+  surface = sg->slice[i].surface;
+  cr = sg->slice[i].cr;
+  pixw = sg->w;
+  pixh = sg->h;
+  source_clr = (color_t)-1; // state of another context
+  source_lw = -1;
+}
+
+/// Recycles the slice an image was put from once the server completed it.
+void draw_completed(const xcb_generic_event_t *ge)
+{
+  const xcb_shm_completion_event_t *e = (const xcb_shm_completion_event_t *)ge;
+  shm_seg_t *sg;
+
+  for (sg = segs; sg && sg->seg != e->shmseg; sg = sg->next) ;
+  if (!sg)
+    return;
+  if (sg->id >= 0) { // the server is attached, the segment can go with us
+    shmctl(sg->id, IPC_RMID, NULL);
+    sg->id = -1;
+  }
+  sg->slice[e->offset / ((size_t)sg->w * sg->h * 4)].pending--;
+  if (sg->retired)
+    shm_release();
+}
+
+/// @return response type of the events draw_completed handles, -1 if none
+int draw_event_type(void)
+{
+  return shm ? shm_event : -1;
+}
+
+// creates the cairo context on the current surface with the selected font
+void draw_set_context(void)
+{
+  if (cr)
+    cairo_destroy(cr);
+  cr = cairo_create(surface);
+  source_clr = 0;
+  source_lw = 2.0; // cairo defaults
+  if (font_face) {
+    cairo_set_font_face(cr, font_face);
+    cairo_set_font_size(cr, font_size);
+  }
+}
+
+// Lets the server render into a pixmap buffer of at least w by h, which grows
+// to the largest bar or tab strip drawn instead of covering the whole screen.
+// It is the fallback whenever shared memory cannot be used.
+void pixmap_setup(int w, int h)
+{
+  draw_set_target(w, h);
+  surface = cairo_xcb_surface_create(sn.conn, pixmap, get_visual_type(sn.scr), pixw, pixh);
   if (cairo_surface_status(surface) != CAIRO_STATUS_SUCCESS)
     die("failed to allocate surface on pixmap");
-  cr = cairo_create(surface);
+  draw_set_context();
+}
+
+void draw_setup(void)
+{
+  uint32_t val = 0;
+
+  // setup xcb graphics context
+  gc = xcb_generate_id(sn.conn);
+  xcb_create_gc(sn.conn, gc, sn.root, XCB_GC_GRAPHICS_EXPOSURES, &val);
+
+  // prefer rendering client side, uploading only what is copied out
+  if ((shm = shm_setup())) {
+    shm_set_target(1, 1);
+    LOGI("rendering into shared memory\n")
+    return;
+  }
+
+  pixmap_setup(1, 1);
 }
 
 void draw_cleanup(void)
 {
-  cairo_destroy(cr);
-  cairo_surface_destroy(surface);
-  xcb_free_pixmap(sn.conn, pixmap);
+  shm_seg_t *sg;
+  int i;
+
+  LOGI("text runs: %u hit(s), %u miss(es), %.3f ms drawing text\n", nhit, nmiss, text_ms)
+  for (i = 0; i < TEXT_RUNS; i++)
+    text_run_clear(&runs[i]);
+  if (font_face)
+    cairo_font_face_destroy(font_face);
+  if (shm) {
+    cseg = NULL;
+    while ((sg = segs)) {
+      segs = sg->next;
+      shm_free(sg);
+    }
+  } else {
+    cairo_destroy(cr);
+    cairo_surface_destroy(surface);
+    xcb_free_pixmap(sn.conn, pixmap);
+  }
   xcb_free_gc(sn.conn, gc);
+  font_face = NULL;
+  surface = NULL;
+  cr = NULL;
+  pixw = pixh = 0;
+}
+
+/// Prepares to draw an area of w by h pixels at the origin. Render targets
+/// grow when too small and never shrink, so they settle at the width of the
+/// widest bar or strip and the height of the tallest.
+void draw_begin(int w, int h)
+{
+  if (shm)
+    shm_set_target(w, h);
+  else if (w > pixw || h > pixh)
+    draw_set_target(MAX(w, pixw), MAX(h, pixh));
 }
 
 // @param height stores the recommended height for a row of text given the font size
 void draw_select_font(const char *face, int size, int *height)
 {
   cairo_font_extents_t fe;
+  shm_seg_t *sg;
+  int i;
 
   cairo_select_font_face(cr, face, CAIRO_FONT_SLANT_NORMAL, CAIRO_FONT_WEIGHT_NORMAL);
   cairo_set_font_size(cr, size);
   cairo_font_extents(cr, &fe);
   font_height = fe.height;
   font_descent = fe.descent;
+  if (font_face) // kept for contexts created on new targets
+    cairo_font_face_destroy(font_face);
+  font_face = cairo_font_face_reference(cairo_get_font_face(cr));
+  font_size = size;
+  for (sg = segs; sg; sg = sg->next)
+    for (i = 0; i < SHM_SLICES; i++) {
+      cairo_set_font_face(sg->slice[i].cr, font_face);
+      cairo_set_font_size(sg->slice[i].cr, font_size);
+    }
+  for (i = 0; i < TEXT_RUNS; i++) // shaped with the previous font
+    text_run_clear(&runs[i]);
   if (height)
     *height = (int)font_height;
   LOGV("selected font %s:%d (suggest row height %d)\n", face, size, (int)font_height)
 }
 
+/// Copies an area of the render target to the same place on a drawable. Out
+/// of shared memory this puts only that area, which the server reads directly
+/// and reports completed through an event for draw_completed.
 void draw_copy(xcb_drawable_t dst, int x, int y, int w, int h)
 {
-  xcb_copy_area(sn.conn, pixmap, dst, gc, x, y, x, y, w, h);
-  xcb_flush(sn.conn);
+  if (shm) {
+    cairo_surface_flush(surface);
+    xcb_shm_put_image(sn.conn, dst, gc, pixw, pixh, x, y, w, h, x, y, sn.scr->root_depth,
+                      XCB_IMAGE_FORMAT_Z_PIXMAP, true, cseg->seg,
+                      (uint32_t)((size_t)pixw * pixh * 4 * cslice));
+    cseg->slice[cslice].pending++;
+  } else
+    xcb_copy_area(sn.conn, pixmap, dst, gc, x, y, x, y, w, h);
 }
 
 void draw_rect(int x, int y, int w, int h, color_t clr, double lw)
@@ -129,25 +461,84 @@ void draw_arc_filled(int x, int y, double r, double deg1, double deg2, color_t c
   cairo_fill(cr);
 }
 
-void draw_text_extents(const char *text, int *tw, int *th)
+void text_run_clear(text_run_t *r)
+{
+  xfree(r->text);
+  if (r->glyph)
+    cairo_glyph_free(r->glyph);
+  r->text = NULL;
+  r->glyph = NULL;
+  r->nglyph = 0;
+}
+
+// Looks up the glyph run of a string, shaping it on a miss. Runs are cached
+// in a direct mapped table keyed by the string hash, a colliding string
+// replaces the previous one. Drawing a cached run skips shaping, the glyphs
+// are still rasterized from the glyph cache of cairo, in client memory when
+// drawing into shared memory and in server glyph sets when into a pixmap.
+text_run_t *text_run(const char *text)
 {
   cairo_text_extents_t te;
+  size_t len = strlen(text);
+  uint32_t h = hash_str(text, len);
+  text_run_t *r = &runs[h & (TEXT_RUNS - 1)];
+
+#ifndef VXWM_DRAW_NO_TEXT_CACHE
+  if (r->text && r->hash == h && r->len == len && memcmp(r->text, text, len) == 0) {
+#ifdef VXWM_DEBUG
+    nhit++;
+#endif
+    return r;
+  }
+#endif
+#ifdef VXWM_DEBUG
+  nmiss++;
+#endif
+  text_run_clear(r);
+  r->text = xmalloc(len + 1);
+  memcpy(r->text, text, len + 1);
+  r->len = len;
+  r->hash = h;
+  if (cairo_scaled_font_text_to_glyphs(cairo_get_scaled_font(cr), 0, 0, text, len,
+                                       &r->glyph, &r->nglyph, NULL, NULL, NULL)
+      != CAIRO_STATUS_SUCCESS) {
+    r->glyph = NULL;
+    r->nglyph = 0;
+  }
+  cairo_scaled_font_glyph_extents(cairo_get_scaled_font(cr), r->glyph, r->nglyph, &te);
+  r->advance = te.x_advance;
+  r->height = te.height;
+  return r;
+}
+
+void draw_text_extents(const char *text, int *tw, int *th)
+{
+  text_run_t *r = text_run(text);
 
-  cairo_text_extents(cr, text, &te);
   if (tw) // slightly larger than actual glyph width
-    *tw = te.x_advance;
+    *tw = r->advance;
   if (th)
-    *th = te.height;
+    *th = r->height;
 }
 
 // TODO: use parameter w
 void draw_text(int x, int y, UNUSED int w, int h, const char *text, color_t clr, int lpad)
 {
+  text_run_t *r;
+#ifdef VXWM_DEBUG
+  double t = time_ms();
+#endif
+
   if (strlen(text) == 0)
     return;
+  r = text_run(text);
   draw_set_color(clr);
-  cairo_move_to(cr, x + lpad, y + h/2. + font_height/2. - font_descent);
-  cairo_show_text(cr, text);
+  cairo_translate(cr, x + lpad, y + h/2. + font_height/2. - font_descent);
+  cairo_show_glyphs(cr, r->glyph, r->nglyph);
+  cairo_identity_matrix(cr);
+#ifdef VXWM_DEBUG
+  text_ms += time_ms() - t;
+#endif
 }
 
 // vim: ts=2:sw=2:et
@@ -3,6 +3,8 @@
 
 // GRAPHICS DRAWING API
 //   utilities to draw on X11 drawables
+//   drawing happens off screen on a target sized by draw_begin,
+//   then draw_copy puts the result on a window
 
 #include <xcb/xcb.h>
 
@@ -11,7 +13,10 @@ typedef uint32_t color_t;
 void draw_setup(void);
 void draw_cleanup(void);
 void draw_select_font(const char *face, int size, int *height);
+void draw_begin(int w, int h);
 void draw_copy(xcb_drawable_t dst, int x, int y, int w, int h);
+int draw_event_type(void);
+void draw_completed(const xcb_generic_event_t *ge);
 void draw_rect(int x, int y, int w, int h, color_t clr, double lw);
 void draw_rect_filled(int x, int y, int w, int h, color_t clr);
 void draw_arc_filled(int x, int y, double r, double deg1, double deg2, color_t clr);
@@ -0,0 +1,95 @@
+#include <stdint.h>
+#include <string.h>
+#include "intern.h"
+#include "util.h"
+
+#define INTERN_MIN_BUCKETS  64
+
+typedef struct istr {
+  struct istr *next;   // bucket chain
+  uint32_t hash;       // hash of the characters
+  uint32_t refs;       // number of holders
+  size_t len;          // length without the terminator
+  char s[];            // the string, null terminated
+} istr_t;
+
+static void intern_grow(void);
+static istr_t **bucket;
+static uint32_t nbucket, cnt;
+
+void intern_grow(void)
+{
+  istr_t **old = bucket, *e, *next;
+  uint32_t i, n = nbucket;
+
+  nbucket = nbucket ? nbucket << 1 : INTERN_MIN_BUCKETS;
+  bucket = xmalloc(sizeof(istr_t *) * nbucket);
+  memset(bucket, 0, sizeof(istr_t *) * nbucket);
+  for (i = 0; i < n; i++)
+    for (e = old[i]; e; e = next) {
+      next = e->next;
+      e->next = bucket[e->hash & (nbucket - 1)];
+      bucket[e->hash & (nbucket - 1)] = e;
+    }
+  xfree(old);
+}
+
+/// Looks up a string, storing a copy on first sight. The text need not be null
+/// terminated, so it can be interned straight from a property reply.
+/// @return shared string to be released with intern_drop
+const char *intern(const char *text, size_t len)
+{
+  uint32_t h = hash_str(text, len);
+  istr_t *e;
+
+  if (cnt >= nbucket)
+    intern_grow();
+  for (e = bucket[h & (nbucket - 1)]; e; e = e->next)
+    if (e->hash == h && e->len == len && memcmp(e->s, text, len) == 0) {
+      e->refs++;
+      return e->s;
+    }
+  e = xmalloc(sizeof(istr_t) + len + 1);
+  e->hash = h;
+  e->refs = 1;
+  e->len = len;
+  memcpy(e->s, text, len);
+  e->s[len] = '\0';
+  e->next = bucket[h & (nbucket - 1)];
+  bucket[h & (nbucket - 1)] = e;
+  cnt++;
+  return e->s;
+}
+
+/// Releases a string from intern, it is freed along with its last holder.
+void intern_drop(const char *s)
+{
+  istr_t *e, **ee;
+
+  if (!s)
+    return;
+  e = (istr_t *)(s - offsetof(istr_t, s));
+  if (--e->refs > 0)
+    return;
+  for (ee = &bucket[e->hash & (nbucket - 1)]; *ee != e; ee = &(*ee)->next) ;
+  *ee = e->next;
+  xfree(e);
+  cnt--;
+}
+
+void intern_cleanup(void)
+{
+  istr_t *e, *next;
+  uint32_t i;
+
+  for (i = 0; i < nbucket; i++)
+    for (e = bucket[i]; e; e = next) {
+      next = e->next;
+      xfree(e);
+    }
+  xfree(bucket);
+  bucket = NULL;
+  nbucket = cnt = 0;
+}
+
+// vim: ts=2:sw=2:et
@@ -0,0 +1,14 @@
+#ifndef VXWM_INTERN_H
+#define VXWM_INTERN_H
+
+// INTERNED STRINGS
+//   immutable, reference counted and deduplicated strings
+//   each string is stored once with room for exactly its length
+
+#include <stddef.h>
+
+const char *intern(const char *, size_t);
+void intern_drop(const char *);
+void intern_cleanup(void);
+
+#endif // VXWM_INTERN_H
@@ -0,0 +1,69 @@
+#include "pool.h"
+#include "util.h"
+
+#define POOL_ALIGN      sizeof(void *)
+
+static void pool_grow(pool_t *);
+
+/// Prepares an empty pool, no memory is allocated until the first object is needed.
+void pool_init(pool_t *p, size_t size, int per_slab)
+{
+  size = MAX(size, sizeof(void *));
+  p->size = (size + POOL_ALIGN - 1) / POOL_ALIGN * POOL_ALIGN;
+  p->per_slab = per_slab;
+  p->free = NULL;
+  p->slab = NULL;
+  p->nslab = p->slabcap = 0;
+}
+
+// allocates a slab and threads its objects onto the free list, in address order
+void pool_grow(pool_t *p)
+{
+  char *mem;
+  int i;
+
+  if (p->nslab == p->slabcap) {
+    p->slabcap = p->slabcap ? p->slabcap << 1 : 4;
+    p->slab = xrealloc(p->slab, sizeof(void *) * p->slabcap);
+  }
+  mem = xmalloc(p->size * p->per_slab);
+  p->slab[p->nslab++] = mem;
+  for (i = p->per_slab - 1; i >= 0; i--) {
+    *(void **)(mem + p->size * i) = p->free;
+    p->free = mem + p->size * i;
+  }
+  LOGV("pool of %zu byte objects grown to %d slab(s)\n", p->size, p->nslab)
+}
+
+void *pool_get(pool_t *p)
+{
+  void *obj;
+
+  if (!p->free)
+    pool_grow(p);
+  obj = p->free;
+  p->free = *(void **)obj;
+  return obj;
+}
+
+void pool_put(pool_t *p, void *obj)
+{
+  if (!obj)
+    return;
+  *(void **)obj = p->free;
+  p->free = obj;
+}
+
+void pool_cleanup(pool_t *p)
+{
+  int i;
+
+  for (i = 0; i < p->nslab; i++)
+    xfree(p->slab[i]);
+  xfree(p->slab);
+  p->free = NULL;
+  p->slab = NULL;
+  p->nslab = p->slabcap = 0;
+}
+
+// vim: ts=2:sw=2:et
@@ -0,0 +1,23 @@
+#ifndef VXWM_POOL_H
+#define VXWM_POOL_H
+
+// FIXED SIZE OBJECT POOL
+//   objects are carved from slabs and recycled through a free list,
+//   slabs are only returned to the system when the pool is cleaned up
+
+#include <stddef.h>
+
+typedef struct pool {
+  size_t size;         // object size, at least a pointer
+  int per_slab;        // objects per slab
+  void *free;          // free list threaded through released objects
+  void **slab;         // allocated slabs
+  int nslab, slabcap;  // number of slabs, slab array capacity
+} pool_t;
+
+void pool_init(pool_t *, size_t, int);
+void *pool_get(pool_t *);
+void pool_put(pool_t *, void *);
+void pool_cleanup(pool_t *);
+
+#endif // VXWM_POOL_H
@@ -0,0 +1,147 @@
+#include <xcb/xcb.h>
+#include "stack.h"
+#include "util.h"
+#include "vxwm.h"
+
+#define STACK_MIN_CAP   16
+
+// model and the scratch buffers of stack_sink share one capacity
+static xcb_window_t *win, *order;
+static int *pos, *tail, *prev;
+static bool *keep;
+static int cnt, cap;
+
+static void stack_grow(void);
+static int stack_find(xcb_window_t);
+
+void stack_grow(void)
+{
+  cap = cap ? cap << 1 : STACK_MIN_CAP;
+  win   = xrealloc(win, sizeof(xcb_window_t) * cap);
+  order = xrealloc(order, sizeof(xcb_window_t) * cap);
+  pos   = xrealloc(pos, sizeof(int) * cap);
+  tail  = xrealloc(tail, sizeof(int) * cap);
+  prev  = xrealloc(prev, sizeof(int) * cap);
+  keep  = xrealloc(keep, sizeof(bool) * cap);
+}
+
+int stack_find(xcb_window_t w)
+{
+  int i;
+
+  for (i = cnt - 1; i >= 0; i--)
+    if (win[i] == w)
+      return i;
+  return -1;
+}
+
+/// Records a window the server just created, new windows go on top of their siblings.
+void stack_push(xcb_window_t w)
+{
+  if (cnt == cap)
+    stack_grow();
+  win[cnt++] = w;
+}
+
+void stack_remove(xcb_window_t w)
+{
+  int i;
+
+  if ((i = stack_find(w)) < 0)
+    return;
+  memmove(win + i, win + i + 1, sizeof(xcb_window_t) * (cnt - i - 1));
+  cnt--;
+}
+
+/// Raises a window on top of all its siblings.
+/// @return false if the window already is the top of the model
+bool stack_raise(xcb_window_t w)
+{
+  uint32_t val = XCB_STACK_MODE_ABOVE;
+  int i;
+
+  if ((i = stack_find(w)) < 0 || i == cnt - 1)
+    return false;
+  xcb_configure_window(sn.conn, w, XCB_CONFIG_WINDOW_STACK_MODE, &val);
+  memmove(win + i, win + i + 1, sizeof(xcb_window_t) * (cnt - i - 1));
+  win[cnt - 1] = w;
+  return true;
+}
+
+/// Moves the windows matching the predicate below all others, the relative
+/// order within both groups is preserved. The frames forming the longest run
+/// already in order stay put, every other frame is restacked directly above
+/// its new lower neighbour.
+/// @return number of restack requests sent
+int stack_sink(stack_pred_t sink)
+{
+  uint32_t vals[2];
+  int i, j, lo, hi, len = 0, n = 0;
+
+  // stable partition of the model into the new order
+  for (i = 0; i < cnt; i++)
+    if (sink(win[i]))
+      pos[n++] = i;
+  for (i = 0; i < cnt; i++)
+    if (!sink(win[i]))
+      pos[n++] = i;
+
+  // longest increasing subsequence of old positions, patience sorting
+  for (i = 0; i < cnt; i++) {
+    for (lo = 0, hi = len; lo < hi; ) {
+      j = (lo + hi) / 2;
+      if (pos[tail[j]] < pos[i])
+        lo = j + 1;
+      else
+        hi = j;
+    }
+    prev[i] = lo > 0 ? tail[lo - 1] : -1;
+    tail[lo] = i;
+    if (lo == len)
+      len++;
+  }
+  memset(keep, 0, sizeof(bool) * cnt);
+  for (i = len > 0 ? tail[len - 1] : -1; i >= 0; i = prev[i])
+    keep[i] = true;
+
+  for (i = 0; i < cnt; i++)
+    order[i] = win[pos[i]];
+  for (i = 0, n = 0; i < cnt; i++) {
+    if (keep[i])
+      continue;
+    if (i == 0) {
+      vals[0] = XCB_STACK_MODE_BELOW;
+      xcb_configure_window(sn.conn, order[i], XCB_CONFIG_WINDOW_STACK_MODE, vals);
+    } else {
+      vals[0] = order[i - 1];
+      vals[1] = XCB_STACK_MODE_ABOVE;
+      xcb_configure_window(sn.conn, order[i],
+                           XCB_CONFIG_WINDOW_SIBLING | XCB_CONFIG_WINDOW_STACK_MODE, vals);
+    }
+    n++;
+  }
+  memcpy(win, order, sizeof(xcb_window_t) * cnt);
+  return n;
+}
+
+/// Exposes the model, bottom to top.
+/// @return number of windows
+int stack_get(const xcb_window_t **list)
+{
+  *list = win;
+  return cnt;
+}
+
+void stack_cleanup(void)
+{
+  xfree(win);
+  xfree(order);
+  xfree(pos);
+  xfree(tail);
+  xfree(prev);
+  xfree(keep);
+  win = order = NULL;
+  cnt = cap = 0;
+}
+
+// vim: ts=2:sw=2:et
@@ -0,0 +1,22 @@
+#ifndef VXWM_STACK_H
+#define VXWM_STACK_H
+
+// STACKING ORDER MODEL
+//   mirror of the server stacking order of client frames, bottom to top
+//   restacks are computed against the model and only the frames that
+//   are out of place are sent to the server
+
+#include <stdbool.h>
+#include <xcb/xproto.h>
+
+// decides whether a window belongs to the bottom of the stack
+typedef bool (*stack_pred_t)(xcb_window_t);
+
+void stack_push(xcb_window_t);
+void stack_remove(xcb_window_t);
+bool stack_raise(xcb_window_t);
+int stack_sink(stack_pred_t);
+int stack_get(const xcb_window_t **);
+void stack_cleanup(void);
+
+#endif // VXWM_STACK_H
@@ -1,6 +1,8 @@
+#define _POSIX_C_SOURCE 199309L // clock_gettime
 #include <stdlib.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <time.h>
 #include "util.h"
 #include "vxwm.h"
 
@@ -33,4 +35,14 @@ void die(const char *emsg)
   exit(EXIT_FAILURE);
 }
 
+// monotonic milliseconds, only meaningful as a difference between two calls,
+// so deadlines are unaffected by the wall clock being set
+double time_ms(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
 // vim: ts=2:sw=2:et
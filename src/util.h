@@ -6,10 +6,13 @@
 //   GCC function attributes
 //   naive macro logging service
 //   memory allocation wrappers
+//   timing for debug metrics
+//   string hashing
 
 #include <stdio.h>
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 #include <string.h>
 #include <xcb/xproto.h>
 #include <xcb/xcb_event.h>
@@ -55,5 +58,16 @@ void *xmalloc(size_t);
 void *xrealloc(void *, size_t);
 void xfree(void *);
 void die(const char *);
+double time_ms(void);
+
+// FNV-1a over len characters
+static inline uint32_t hash_str(const char *s, size_t len)
+{
+  uint32_t h = 2166136261u;
+
+  while (len--)
+    h = (h ^ (uint8_t)*s++) * 16777619u;
+  return h;
+}
 
 #endif // VXWM_UTIL_H
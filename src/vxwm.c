@@ -2,6 +2,7 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include <unistd.h>
+#include <poll.h>
 #include <X11/keysym.h>
 #include <X11/cursorfont.h>
 #include <xcb/xcb.h>
@@ -15,21 +16,31 @@
 #include "util.h"
 #include "win.h"
 #include "draw.h"
+#include "wmap.h"
+#include "async.h"
+#include "stack.h"
+#include "pool.h"
+#include "intern.h"
 
 #define VXWM_CLN_MIN_W           30
 #define VXWM_CLN_MIN_H           30
-#define VXWM_TAB_NAME_BUF        128
 #define VXWM_ROOT_NAME_BUF       128
 #define VXWM_LT_STATUS_BUF       32
+#define VXWM_EVENT_BATCH         128
+#define VXWM_MAX_PAGES           32  // one per bit of a client tag
+#define VXWM_TAB_CLASSES         7   // tab arrays of 1 to 64 tabs, one per bit of a selection
+#define VXWM_POOL_SLAB           64
 #define BORDER                   2 * VXWM_CLN_BORDER_W
 #define INPAGE(C)                (C->tag & 1 << fm->fp)
+// compacts a modifier state without caps lock into a 7 bit key table index
+#define KEY_MODS(S)              (((S) & XCB_MOD_MASK_SHIFT) | (((S) >> 1) & 0x7e))
+#define KEY_MODS_COUNT           128
 
 #define VXWM_ROOT_EVENT_MASK    (XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY |\
                                  XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT |\
                                  XCB_EVENT_MASK_PROPERTY_CHANGE)
 
 #define VXWM_FRAME_EVENT_MASK   (XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT |\
-                                 XCB_EVENT_MASK_EXPOSURE |\
                                  XCB_EVENT_MASK_ENTER_WINDOW)
 
 #define VXWM_WIN_EVENT_MASK     (XCB_EVENT_MASK_STRUCTURE_NOTIFY |\
@@ -40,14 +51,42 @@
 #define NET_WM_STATE_ADD         1
 #define NET_WM_STATE_TOGGLE      2
 
+// status bar segments, in drawing order
+enum {
+  SegPages = 0,  // page symbols and tags of the focus client
+  SegStatus,     // layout status
+  SegTitle,      // focus tab title
+  SegRoot,       // root window name
+  SegCount,
+};
+
+// reasons for a monitor to be committed
+enum {
+  DirtyLayout = 1 << 0, // tiled clients need to be arranged
+  DirtyBar    = 1 << 1, // status bar needs to be drawn
+  DirtyFocus  = 1 << 2, // focus goes to the pending client once arranged
+};
+
+// a horizontal span of the status bar and a key of what it shows
+typedef struct {
+  int x, w;
+  uint64_t key;
+} bar_seg_t;
+
 // a monitor corresponds to a physical display and contains pages
 struct monitor {
   monitor_t *next;     // monitor linked list
   client_t *cln;       // clients under this monitor
+  client_t *ph[VXWM_MAX_PAGES]; // first client of each page
+  client_t *pt[VXWM_MAX_PAGES]; // last client of each page
   int np, fp;          // number of pages, index of focus page
   int lx, ly, lw, lh;  // layout space where tiled clients are arranged in
   xcb_window_t barwin; // status bar window
   int barh;            // status bar height
+  xcb_pixmap_t barpix; // rendered status bar, serving as bar background
+  bar_seg_t seg[SegCount]; // status bar segments barpix shows
+  uint32_t dirty;      // work deferred to the next commit
+  client_t *nf;        // client pending focus
   char lt_status[VXWM_LT_STATUS_BUF]; // layout status buffer
 };
 
@@ -65,20 +104,47 @@ struct layout_arg {
   int ntiled;          // number of tiled clients in focus page
 };
 
-// a client is one or more tabbed windows living under a monitor
+// links of a client in the client list of a page
+typedef struct plink {
+  client_t *prev, *next;
+} plink_t;
+
+// a client is one or more tabbed windows living under a monitor,
+// fields read when walking clients come first and share cache lines
 struct client {
-  client_t *next;      // client linked list
-  xcb_window_t frame;  // client frame
-  xcb_window_t *tab;   // window tabs
+  client_t *next;      // client linked list, in no particular order
   uint32_t tag;        // page tag bitmask
-  uint64_t sel;        // tab selection bitmask
-  int tcap;            // maximum tab capacity
+  bool ismapped;       // frame is mapped, clients on hidden pages are not
+  bool isfloating;     // client is floating
+  bool isfullscr;      // client wishes to be fullscreen
   int nt, ft;          // number of tabs, index of focus tab
+  uint64_t sel;        // tab selection bitmask
   int x, y, w, h;      // client dimensions
+  xcb_window_t frame;  // client frame
+  tab_t *tab;          // window tabs
+  int tcls;            // tab array size class, capacity is 1 << tcls
   int px, py, pw, ph;  // previous client dimensions
-  bool isfloating;     // client is floating
-  bool isfullscr;      // client wishes to be fullscreen
-  char (*name)[VXWM_TAB_NAME_BUF]; // name buffer for tabs
+  int sx, sy, sw, sh;  // frame geometry last sent to the server
+  int sbw;             // frame border width last sent to the server
+  xcb_window_t tabbar; // frame child along its top, showing the strip
+  xcb_pixmap_t strip;  // rendered tab strip, serving as tab bar background
+  int stw, snt, sft;   // width, tab count and focus tab the strip shows
+  uint64_t ssel;       // tab selection the strip shows
+  bool sfocus;         // strip shows the focus client
+  plink_t pl[VXWM_MAX_PAGES]; // page client lists, in layout order
+};
+
+// a tab is a client window hosted in a client frame,
+// the title is interned so that moving tabs around stays cheap
+struct tab {
+  xcb_window_t win;    // client window
+  int w, h;            // window size last sent to the server
+  int unmaps;          // pending unmap notifies caused by us
+  bool ismapped;       // window is mapped
+  bool isstale;        // title changed since it was last fetched
+  uint32_t state;      // WM_STATE last written
+  const char *name;    // window title, interned
+  win_props_t props;   // cached window properties
 };
 
 // key bindings
@@ -97,6 +163,22 @@ struct btnbind {
   arg_t arg;
 };
 
+// a frame released by a deleted client, kept unmapped with its button grabs
+// in place so that the next client needs neither a new window nor new grabs
+typedef struct {
+  xcb_window_t win, tabbar;
+  int x, y, w, h, bw;  // geometry last sent to the server
+} frame_t;
+
+// replies requested ahead of managing a window, so that adopting
+// many windows at once waits for the server once instead of per request
+typedef struct {
+  xcb_window_t win;
+  xcb_get_property_cookie_t net_name, name;
+  xcb_get_property_cookie_t prop[WinPropsCount];
+  xcb_get_geometry_cookie_t geom;
+} manage_req_t;
+
 typedef enum {
   CursorNormal = 0,
   CursorMove,
@@ -108,56 +190,98 @@ static void args(int, char **);
 static void setup(void);
 static void scan(void);
 static void run(void);
+static void dispatch(xcb_generic_event_t *);
+static void batch_push(xcb_generic_event_t *);
+static bool superseded(xcb_generic_event_t **, int, int);
 static void cleanup(void);
+static void flush(void);
+static void flush_urgent(void);
+static void update_client_list(void);
 static void atom_setup(void);
 static void cursor_setup(void);
 static void cursor_cleanup(void);
-static xcb_keycode_t *keysym_to_keycodes(xcb_keysym_t);
 static xcb_keysym_t keycode_to_keysym(xcb_keycode_t);
-static void grab_keys(void);
+static void update_numlock(void);
+static void grab_keys(xcb_keycode_t, int);
 static void ptr_grab(cursor_t);
 static void ptr_motion(cursor_t);
 static void ptr_ungrab(void);
 static void grant_configure_request(xcb_configure_request_event_t *);
 static void on_key_press(xcb_generic_event_t *);
+static void on_mapping_notify(xcb_generic_event_t *);
 static void on_button_press(xcb_generic_event_t *);
 static void on_enter_notify(xcb_generic_event_t *);
 static void on_focus_in(xcb_generic_event_t *);
-static void on_expose(xcb_generic_event_t *);
 static void on_destroy_notify(xcb_generic_event_t *);
 static void on_unmap_notify(xcb_generic_event_t *);
 static void on_map_request(xcb_generic_event_t *);
 static void on_configure_request(xcb_generic_event_t *);
 static void on_property_notify(xcb_generic_event_t *);
 static void on_client_message(xcb_generic_event_t *);
+static void on_root_name(void *, xcb_window_t, void *);
+static void on_net_wm_name(void *, xcb_window_t, void *);
+static void on_wm_name(void *, xcb_window_t, void *);
+static void on_tab_prop(void *, xcb_window_t, void *);
+static void on_manage_attr(void *, xcb_window_t, void *);
 static monitor_t *mon_create(void);
 static void mon_delete(monitor_t *);
-static void mon_arrange(monitor_t *);
+static void mon_invalidate(monitor_t *, uint32_t);
+static void mon_refocus(monitor_t *, client_t *);
+static void mon_commit(monitor_t *);
+static bool mon_arrange(monitor_t *);
 static void mon_draw_bar(monitor_t *);
 static client_t *cln_create(void);
-static void cln_manage(xcb_window_t);
+static void cln_manage_request(manage_req_t *, xcb_window_t);
+static void cln_manage_cancel(manage_req_t *);
+static void cln_manage_drop(void *);
+static client_t *cln_manage(manage_req_t *);
 static void cln_delete(client_t *);
 static void cln_unmanage(client_t *);
 static void cln_set_border(client_t *, int);
 static void cln_frame(client_t *);
+static void cln_create_frame(client_t *);
 static void cln_unframe(client_t *);
 static void cln_attach(client_t *);
 static void cln_detach(client_t *);
 static void cln_set_focus(client_t *);
 static void cln_raise(client_t *);
 static void cln_set_fullscr(client_t *, bool);
+static bool cln_configure_frame(client_t *, int, int, int, int, int);
+static bool cln_configure_tab(client_t *, int);
+static void cln_presize_tabs(monitor_t *);
+static void cln_commit_geometry(client_t *);
 static void cln_move(client_t *, int, int);
-static void cln_resize(client_t *, int, int);
+static bool cln_resize(client_t *, int, int);
 static void cln_move_resize(client_t *, int, int, int, int);
+static void cln_set_state(tab_t *, uint32_t);
+static void cln_map_tab(tab_t *, bool);
+static void cln_sync_tabs(client_t *);
+static void cln_map(client_t *, bool);
 static void cln_show_hide(monitor_t *);
 static void cln_set_tag(client_t *, uint32_t, bool);
-static void cln_attach_tab(client_t *, xcb_window_t);
+static void cln_reserve_tabs(client_t *, int);
+static void cln_attach_tab(client_t *, const tab_t *);
+static void cln_adopt_tab(client_t *, const tab_t *);
 static void cln_detach_tab(client_t *, xcb_window_t);
-static void cln_update_title(client_t *, xcb_window_t);
+static void cln_compact_tabs(client_t *, uint64_t);
+static int cln_transfer_tabs(client_t *, uint64_t, client_t *);
+static void cln_remove_tab(client_t *, xcb_window_t);
+static void cln_stale_title(tab_t *);
+static void cln_fetch_title(tab_t *);
+static void cln_refresh_titles(monitor_t *);
+static tab_t *tabs_get(int);
+static void tabs_put(tab_t *, int);
+static bool cln_update_title(xcb_window_t, xcb_get_property_reply_t *);
 static void cln_draw_tabs(client_t *);
+static void cln_link_page(client_t *, int, client_t *);
+static void cln_unlink_page(client_t *, int);
+static client_t *first_inpage(monitor_t *);
+static client_t *last_inpage(monitor_t *);
 static client_t *next_inpage(client_t *);
 static client_t *prev_inpage(client_t *);
 static client_t *next_tiled(client_t *);
+static client_t *prev_tiled(client_t *);
+static bool is_tiled_frame(xcb_window_t);
 static client_t *next_selected(client_t *);
 static client_t *cln_from_tab(xcb_window_t);
 static client_t *cln_from_frame(xcb_window_t);
@@ -194,25 +318,40 @@ static int nsel;
 static int barh;
 static uint32_t vals[8], masks;
 static char root_name[VXWM_ROOT_NAME_BUF];
+static xcb_window_t *clist; // last published client list
+static int clen, ccap;
+static xcb_generic_event_t **batch; // events to handle next, in arrival order
+static int nbatch, batchcap;
+static unsigned int nflush; // flushes since the last user input
+static unsigned int nprop;  // property writes since the last user input
+static pool_t cln_pool;     // client storage
+static pool_t tab_pool[VXWM_TAB_CLASSES]; // tab arrays by size class
+static int nspare;           // released frames kept for reuse
+static bool tabs_stale;     // background tabs may not fit their client
+static int nstale;          // tabs with a stale title
+static double titles_due;   // time of the next background title refresh
+static uint16_t numlock;    // modifier currently bound to num lock
+static uint16_t keytab[256][KEY_MODS_COUNT]; // keybind index + 1, by keycode and modifiers
 static const handler_t handler[XCB_NO_OPERATION] = {
   [XCB_KEY_PRESS] = on_key_press,
   [XCB_BUTTON_PRESS] = on_button_press,
 //[XCB_MOTION_NOTIFY] = on_motion_notify,
   [XCB_ENTER_NOTIFY] = on_enter_notify,
   [XCB_FOCUS_IN] = on_focus_in,
-  [XCB_EXPOSE] = on_expose,
   [XCB_DESTROY_NOTIFY] = on_destroy_notify,
   [XCB_UNMAP_NOTIFY] = on_unmap_notify,
   [XCB_MAP_REQUEST] = on_map_request,
   [XCB_CONFIGURE_REQUEST] = on_configure_request,
   [XCB_PROPERTY_NOTIFY] = on_property_notify,
   [XCB_CLIENT_MESSAGE] = on_client_message,
-//[XCB_MAPPING_NOTIFY]  = on_mapping_notify,
+  [XCB_MAPPING_NOTIFY] = on_mapping_notify,
 };
 session_t sn; // global session instance
 
 // will exist until lua configuration is implemented
 #include "config.h"
+_Static_assert(LENGTH(pages) <= VXWM_MAX_PAGES, "too many pages");
+static frame_t spare[VXWM_FRAME_SPARE];
 
 void args(int argc, char **argv)
 {
@@ -229,7 +368,7 @@ void setup(void)
 {
   xcb_void_cookie_t cookie;
   xcb_generic_error_t *error;
-  int screen_id;
+  int screen_id, i;
 
   // connect to X server
   sn.conn = xcb_connect(NULL, &screen_id);
@@ -244,7 +383,6 @@ void setup(void)
   vals[0] = VXWM_ROOT_EVENT_MASK;
   cookie = xcb_change_window_attributes_checked(sn.conn, sn.root, XCB_CW_EVENT_MASK, vals);
   error = xcb_request_check(sn.conn, cookie);
-  xcb_flush(sn.conn);
   if (error)
     die("another window manager is running\n");
   LOGV("configured root window %d\n", sn.root)
@@ -254,14 +392,18 @@ void setup(void)
   draw_select_font(VXWM_FONT, VXWM_FONT_SIZE, &barh);
   atom_setup();
   cursor_setup();
+  wmap_setup();
+  pool_init(&cln_pool, sizeof(client_t), VXWM_POOL_SLAB);
+  for (i = 0; i < VXWM_TAB_CLASSES; i++)
+    pool_init(&tab_pool[i], sizeof(tab_t) << i, VXWM_POOL_SLAB >> i);
   fm = mon_create();
 
   // load symbols and grab keys on root window
   symbols = xcb_key_symbols_alloc(sn.conn);
   if (!symbols)
     die("failed to allocate key symbol table\n");
-  grab_keys();
-  xcb_flush(sn.conn);
+  update_numlock();
+  grab_keys(xcb_get_setup(sn.conn)->min_keycode, -1);
 
   // initialize status globals
   strncpy(root_name, "vxwm "VXWM_VERSION, VXWM_ROOT_NAME_BUF);
@@ -270,59 +412,258 @@ void setup(void)
   running = true;
 }
 
+// adopt existing windows in three pipelined passes: request the attributes
+// of every child, then request what managing needs for every viewable one,
+// and only then collect replies, so the server is waited on twice in total
 void scan(void)
 {
   xcb_query_tree_cookie_t qtc;
   xcb_query_tree_reply_t *qtr;
+  xcb_get_window_attributes_cookie_t *wac;
+  xcb_get_window_attributes_reply_t *war;
   xcb_window_t *win;
-  uint8_t map_state;
-  bool override_redirect;
-  int i, nwin;
+  manage_req_t *mr;
+  client_t *c = NULL;
+  UNUSED double t0 = time_ms();
+  int i, n, nwin;
 
   qtc = xcb_query_tree(sn.conn, sn.root);
   qtr = xcb_query_tree_reply(sn.conn, qtc, NULL);
-  if (!qtr || !(win = xcb_query_tree_children(qtr)))
+  if (!qtr || !(win = xcb_query_tree_children(qtr))) {
+    xfree(qtr);
     return;
+  }
   nwin = xcb_query_tree_children_length(qtr);
-  for (i = 0; i < nwin; i++) {
+  wac = xmalloc(sizeof(xcb_get_window_attributes_cookie_t) * nwin);
+  mr = xmalloc(sizeof(manage_req_t) * nwin);
+
+  for (i = 0; i < nwin; i++)
+    wac[i] = xcb_get_window_attributes(sn.conn, win[i]);
+  for (i = n = 0; i < nwin; i++) {
     LOGV("scanning %d\n", win[i])
-    win_get_attr(win[i], &override_redirect, &map_state);
-    if (override_redirect || map_state == XCB_MAP_STATE_UNMAPPED)
+    if (!(war = xcb_get_window_attributes_reply(sn.conn, wac[i], NULL)))
       continue;
-    cln_manage(win[i]);
+    if (!war->override_redirect && war->map_state != XCB_MAP_STATE_UNMAPPED)
+      cln_manage_request(&mr[n++], win[i]);
+    xfree(war);
+  }
+  for (i = 0; i < n; i++)
+    c = cln_manage(&mr[i]);
+
+  // arrange and draw once for all adopted windows
+  if (c) {
+    mon_invalidate(fm, DirtyLayout);
+    mon_refocus(fm, c);
+    mon_commit(fm);
   }
+  xfree(mr);
+  xfree(wac);
   xfree(qtr);
-  xcb_flush(sn.conn);
+  LOGI("adopted %d of %d windows in %.2f ms\n", n, nwin, time_ms() - t0)
 }
 
+// handle every event that arrived as one batch, dropping those made redundant
+// by a later event in the same batch, then every reply we are waiting on,
+// then sleep on the connection until the server sends something new
 void run(void)
 {
   xcb_generic_event_t *ge;
-  uint8_t type;
+  struct pollfd pfd;
+  bool busy;
+  int i;
 
-  xcb_flush(sn.conn);
-  while (running && (ge = xcb_wait_for_event(sn.conn))) {
-    type = XCB_EVENT_RESPONSE_TYPE(ge);
-    if (handler[type])
-      handler[type](ge);
-    xfree(ge);
+  pfd.fd = xcb_get_file_descriptor(sn.conn);
+  pfd.events = POLLIN;
+  while (running && !xcb_connection_has_error(sn.conn)) {
+    // events already drained from the queue come first, the batch may grow
+    // while it is handled as handlers drain the queue further
+    while (nbatch < VXWM_EVENT_BATCH && (ge = xcb_poll_for_event(sn.conn)))
+      batch_push(ge);
+    for (i = 0; i < nbatch; i++)
+      if (running && !superseded(batch, i, nbatch))
+        dispatch(batch[i]);
+      else
+        xfree(batch[i]);
+    busy = nbatch > 0;
+    nbatch = 0;
+    if (async_dispatch() > 0)
+      busy = true;
+    if (nstale > 0 && time_ms() >= titles_due)
+      cln_refresh_titles(fm);
+    mon_commit(fm);
+    flush();
+    if (busy || nbatch > 0)
+      continue;
+    // layout has settled, size background tabs ahead of switching to them
+    if (tabs_stale) {
+      cln_presize_tabs(fm);
+      flush();
+      continue;
+    }
+    // flushing may have read events into the queue while the socket was full
+    if ((ge = xcb_poll_for_queued_event(sn.conn)))
+      batch_push(ge);
+    else
+      poll(&pfd, 1, nstale > 0 ? MAX(0, (int)(titles_due - time_ms())) : -1);
+  }
+}
+
+// appends an event read from the queue to the batch being handled
+void batch_push(xcb_generic_event_t *ge)
+{
+  if (nbatch == batchcap) {
+    batchcap = batchcap ? batchcap << 1 : VXWM_EVENT_BATCH;
+    batch = xrealloc(batch, sizeof(xcb_generic_event_t *) * batchcap);
+  }
+  batch[nbatch++] = ge;
+}
+
+// user input acts on the state the user sees, so work deferred
+// by earlier events in the batch is committed before it
+INLINE
+void dispatch(xcb_generic_event_t *ge)
+{
+  uint8_t type = XCB_EVENT_RESPONSE_TYPE(ge);
+
+  if (type == XCB_KEY_PRESS || type == XCB_BUTTON_PRESS) {
+    mon_commit(fm);
+    LOGI("%u flush(es) and %u property write(s) since the last input\n", nflush, nprop)
+    nflush = nprop = 0;
+  }
+  if (type == draw_event_type())
+    draw_completed(ge);
+  else if (handler[type])
+    handler[type](ge);
+  xfree(ge);
+}
+
+// checks if a later event in the batch makes ev[i] redundant, that is
+// a property change of the same window and atom, or a configure request of
+// the same window which ev[i] is folded into
+bool superseded(xcb_generic_event_t **ev, int i, int n)
+{
+  uint8_t type = XCB_EVENT_RESPONSE_TYPE(ev[i]);
+  xcb_property_notify_event_t *pe = (xcb_property_notify_event_t *)ev[i], *pj;
+  xcb_configure_request_event_t *ce = (xcb_configure_request_event_t *)ev[i], *cj;
+  int j;
+
+  if (type != XCB_PROPERTY_NOTIFY && type != XCB_CONFIGURE_REQUEST)
+    return false;
+
+  for (j = i + 1; j < n; j++) {
+    if (XCB_EVENT_RESPONSE_TYPE(ev[j]) != type)
+      continue;
+    switch (type) {
+      case XCB_PROPERTY_NOTIFY:
+        pj = (xcb_property_notify_event_t *)ev[j];
+        if (pj->window == pe->window && pj->atom == pe->atom)
+          return true;
+        break;
+      case XCB_CONFIGURE_REQUEST:
+        cj = (xcb_configure_request_event_t *)ev[j];
+        if (cj->window != ce->window)
+          break;
+#define FOLD(MASK, FIELD) if ((ce->value_mask & ~cj->value_mask) & MASK) cj->FIELD = ce->FIELD;
+        FOLD(XCB_CONFIG_WINDOW_X, x)
+        FOLD(XCB_CONFIG_WINDOW_Y, y)
+        FOLD(XCB_CONFIG_WINDOW_WIDTH, width)
+        FOLD(XCB_CONFIG_WINDOW_HEIGHT, height)
+        FOLD(XCB_CONFIG_WINDOW_BORDER_WIDTH, border_width)
+        FOLD(XCB_CONFIG_WINDOW_SIBLING, sibling)
+        FOLD(XCB_CONFIG_WINDOW_STACK_MODE, stack_mode)
+#undef FOLD
+        cj->value_mask |= ce->value_mask;
+        return true;
+    }
   }
+  return false;
 }
 
 void cleanup(void)
 {
+  int i;
+
   // TODO: kill remaining clients
 
   // free resources and disconnect
+  async_cleanup();
   cursor_cleanup();
   draw_cleanup();
   mon_delete(fm);
+  wmap_cleanup();
+  stack_cleanup();
+  if (sn.conn && !xcb_connection_has_error(sn.conn))
+    for (i = 0; i < nspare; i++)
+      xcb_destroy_window(sn.conn, spare[i].win);
+  nspare = 0;
+  pool_cleanup(&cln_pool);
+  for (i = 0; i < VXWM_TAB_CLASSES; i++)
+    pool_cleanup(&tab_pool[i]);
+  intern_cleanup();
+  xfree(clist);
+  while (nbatch > 0)
+    xfree(batch[--nbatch]);
+  xfree(batch);
+  if (sn.conn && !xcb_connection_has_error(sn.conn))
+    xcb_delete_property(sn.conn, sn.root, sn.net_atom[NetClientListStacking]);
   if (symbols)
     xcb_key_symbols_free(symbols);
-  if (sn.conn && !xcb_connection_has_error(sn.conn))
+  if (sn.conn && !xcb_connection_has_error(sn.conn)) {
+    xcb_flush(sn.conn); // requests above are only queued
     xcb_disconnect(sn.conn);
+  }
+}
+
+/// Writes the output buffer to the server. Requests are only flushed once per
+/// batch of events by the event loop and once per step of pointer motion,
+/// right before waiting for more input.
+INLINE
+void flush(void)
+{
+  xcb_flush(sn.conn);
+  nflush++;
 }
 
+/// Flushes outside of the regular commit points, only meant for requests
+/// that have to be ordered against something outside the X connection.
+void flush_urgent(void)
+{
+  LOGV("urgent flush\n")
+  flush();
+}
+
+/// Publishes the managed windows bottom to top, in the order of their frames
+/// with each focus tab last. The property is only written when it changes.
+void update_client_list(void)
+{
+  const xcb_window_t *frames;
+  client_t *c;
+  int i, j, k, n, len = 0;
+  bool changed = false;
+
+  n = stack_get(&frames);
+  for (i = 0; i < n; i++) {
+    if (!(c = cln_from_frame(frames[i])))
+      continue;
+    for (j = 0; j < c->nt; j++, len++) {
+      if (len == ccap) {
+        ccap = ccap ? ccap << 1 : 16;
+        clist = xrealloc(clist, sizeof(xcb_window_t) * ccap);
+      }
+      k = j < c->ft ? j : j + 1 < c->nt ? j + 1 : c->ft;
+      if (len >= clen || clist[len] != c->tab[k].win)
+        changed = true;
+      clist[len] = c->tab[k].win;
+    }
+  }
+  if (!changed && len == clen)
+    return;
+  clen = len;
+  nprop++;
+  xcb_change_property(sn.conn, XCB_PROP_MODE_REPLACE, sn.root, sn.net_atom[NetClientListStacking],
+                      XCB_ATOM_WINDOW, 32, (uint32_t)len, clist);
+  LOGV("client list updated: %d windows\n", len)
+}
 
 #define ATOM(NAME) xcb_intern_atom(sn.conn, false, (uint16_t)strlen(NAME), NAME)
 void atom_setup(void)
@@ -342,6 +683,7 @@ void atom_setup(void)
   net_cookies[NetWmStateFullscreen] = ATOM("_NET_WM_STATE_FULLSCREEN");
   net_cookies[NetWmWindowType] = ATOM("_NET_WM_WINDOW_TYPE");
   net_cookies[NetWmWindowTypeDialog] = ATOM("_NET_WM_WINDOW_TYPE_DIALOG");
+  net_cookies[NetClientListStacking] = ATOM("_NET_CLIENT_LIST_STACKING");
 
   for (i = 0; i < WmAtomsCount; i++)
     if ((reply = xcb_intern_atom_reply(sn.conn, wm_cookies[i], NULL))) {
@@ -383,32 +725,67 @@ void cursor_cleanup(void)
   xcb_cursor_context_free(cursor_ctx);
 }
 
-xcb_keycode_t *keysym_to_keycodes(xcb_keysym_t keysym)
-{
-  xcb_keycode_t *keycodes;
-
-  keycodes = xcb_key_symbols_get_keycode(symbols, keysym); // this can be slow
-  assert(keycodes && "failed to allocate keycodes from symbol table");
-  return keycodes; // remember to free this
-}
-
 xcb_keysym_t keycode_to_keysym(xcb_keycode_t keycode)
 {
   return xcb_key_symbols_get_keysym(symbols, keycode, 0);
 }
 
-void grab_keys(void)
+// finds the modifier num lock is bound to, it is ignored like caps lock
+void update_numlock(void)
 {
-  xcb_keycode_t *keycodes;
+  xcb_get_modifier_mapping_reply_t *mmr;
+  xcb_keycode_t *modmap, *keycodes;
   int i, j, n;
 
-  xcb_ungrab_key(sn.conn, XCB_GRAB_ANY, sn.root, XCB_MOD_MASK_ANY);
-  for (i = 0, n = LENGTH(keybinds); i < n; i++) {
-    keycodes = keysym_to_keycodes(keybinds[i].sym);
-    for (j = 0; keycodes[j] != XCB_NO_SYMBOL; j++)
-      xcb_grab_key(sn.conn, 1, sn.root, keybinds[i].mod, keycodes[j],
-                   XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
-    xfree(keycodes);
+  numlock = 0;
+  mmr = xcb_get_modifier_mapping_reply(sn.conn, xcb_get_modifier_mapping(sn.conn), NULL);
+  keycodes = xcb_key_symbols_get_keycode(symbols, XK_Num_Lock);
+  if (mmr && keycodes) {
+    modmap = xcb_get_modifier_mapping_keycodes(mmr);
+    n = mmr->keycodes_per_modifier;
+    for (i = 0; i < 8 * n; i++)
+      for (j = 0; keycodes[j] != XCB_NO_SYMBOL; j++)
+        if (modmap[i] != XCB_NO_SYMBOL && modmap[i] == keycodes[j])
+          numlock = (uint16_t)(1 << (i / n));
+  }
+  xfree(keycodes);
+  xfree(mmr);
+  LOGV("num lock modifier mask: %#x\n", numlock)
+}
+
+/// Compiles the key bindings of a range of keycodes into the key table and
+/// grabs them regardless of the lock modifiers.
+/// @param count number of keycodes, negative for all keycodes from the first
+void grab_keys(xcb_keycode_t first, int count)
+{
+  const uint16_t locks[] = { 0, XCB_MOD_MASK_LOCK, numlock, XCB_MOD_MASK_LOCK | numlock };
+  const int nlocks = numlock ? LENGTH(locks) : 2; // the rest repeat without num lock
+  xcb_keysym_t keysym;
+  int i, j, k, n, last;
+
+  last = xcb_get_setup(sn.conn)->max_keycode;
+  if (count >= 0)
+    last = MIN(last, first + count - 1);
+  if (count < 0)
+    xcb_ungrab_key(sn.conn, XCB_GRAB_ANY, sn.root, XCB_MOD_MASK_ANY);
+  for (k = first; k <= last; k++) {
+    if (count >= 0)
+      xcb_ungrab_key(sn.conn, (xcb_keycode_t)k, sn.root, XCB_MOD_MASK_ANY);
+    memset(keytab[k], 0, sizeof(keytab[k]));
+    if ((keysym = keycode_to_keysym((xcb_keycode_t)k)) == XCB_NO_SYMBOL)
+      continue;
+    for (i = 0, n = LENGTH(keybinds); i < n; i++) {
+      if (keybinds[i].sym != keysym)
+        continue;
+      if (keytab[k][KEY_MODS(keybinds[i].mod)]) {
+        LOGW("duplicate key binding for keysym %#x ignored\n", keysym)
+        continue;
+      }
+      keytab[k][KEY_MODS(keybinds[i].mod)] = (uint16_t)(i + 1);
+      for (j = 0; j < nlocks; j++)
+        xcb_grab_key(sn.conn, 1, sn.root, keybinds[i].mod | locks[j], (xcb_keycode_t)k,
+                     XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC);
+    }
   }
 }
 
@@ -444,10 +821,13 @@ void ptr_motion(cursor_t cur)
   py = qpr->root_y;
   xfree(qpr);
 
-  win_get_geometry(fc->frame, &wx, &wy, &ww, &wh, NULL);
+  wx = fc->x;
+  wy = fc->y;
+  ww = fc->w;
+  wh = fc->h;
   ptr_first_motion = true;
 
-  xcb_flush(sn.conn);
+  flush();
   do {
     ge = xcb_wait_for_event(sn.conn);
     type = XCB_EVENT_RESPONSE_TYPE(ge);
@@ -461,27 +841,33 @@ void ptr_motion(cursor_t cur)
           ptr_first_motion = false;
           fc->isfloating = true;
           cln_raise(fc);
-          mon_arrange(fm);
+          mon_invalidate(fm, DirtyLayout);
         }
         dx = e->root_x - px;
         dy = e->root_y - py;
         xw = (cur == CursorMove ? wx : ww) + dx;
         yh = (cur == CursorMove ? wy : wh) + dy;
-        (cur == CursorMove ? cln_move : cln_resize)(fc, xw, yh);
-        xcb_flush(sn.conn);
+        if (cur == CursorMove)
+          cln_move(fc, xw, yh);
+        else
+          cln_resize(fc, xw, yh);
         break;
       default:
-        if (handler[type])
+        if (type == draw_event_type())
+          draw_completed(ge);
+        else if (handler[type])
           handler[type](ge);
     }
     xfree(ge);
+    async_dispatch();
+    mon_commit(fm);
+    flush();
   } while (type != XCB_BUTTON_RELEASE);
 }
 
 void ptr_ungrab(void)
 {
   xcb_ungrab_pointer(sn.conn, XCB_CURRENT_TIME);
-  xcb_flush(sn.conn);
 }
 
 void grant_configure_request(xcb_configure_request_event_t *e)
@@ -523,13 +909,31 @@ void grant_configure_request(xcb_configure_request_event_t *e)
 void on_key_press(xcb_generic_event_t *ge)
 {
   xcb_key_press_event_t *e = (xcb_key_press_event_t *)ge;
-  xcb_keysym_t keysym = keycode_to_keysym(e->detail);
-  int i, n;
+  const keybind_t *kb;
+  uint16_t i;
   LOGV("on_key_press: %d @ %d\n", e->event, e->sequence)
 
-  for (i = 0, n = LENGTH(keybinds); i < n; i++)
-    if (keysym == keybinds[i].sym && e->state == keybinds[i].mod && keybinds[i].fn)
-      keybinds[i].fn(&keybinds[i].arg);
+  if (!(i = keytab[e->detail][KEY_MODS(e->state & ~(XCB_MOD_MASK_LOCK | numlock))]))
+    return;
+  kb = &keybinds[i - 1];
+  if (kb->fn)
+    kb->fn(&kb->arg);
+}
+
+void on_mapping_notify(xcb_generic_event_t *ge)
+{
+  xcb_mapping_notify_event_t *e = (xcb_mapping_notify_event_t *)ge;
+  LOGV("on_mapping_notify: %d\n", e->request)
+
+  if (e->request == XCB_MAPPING_POINTER)
+    return;
+  xcb_refresh_keyboard_mapping(symbols, e);
+  // num lock moving to another modifier changes every lock variant grabbed
+  if (e->request == XCB_MAPPING_MODIFIER) {
+    update_numlock();
+    grab_keys(xcb_get_setup(sn.conn)->min_keycode, -1);
+  } else
+    grab_keys(e->first_keycode, e->count);
 }
 
 void on_button_press(xcb_generic_event_t *ge)
@@ -558,10 +962,8 @@ void on_enter_notify(xcb_generic_event_t *ge)
     return;
   LOGV("on_enter_notify: %d, %d @ %d\n", e->event, e->detail, e->sequence)
 
-  if ((c = cln_from_frame(e->event))) {
+  if ((c = cln_from_frame(e->event)))
     cln_set_focus(c);
-    xcb_flush(sn.conn);
-  }
 }
 
 void on_focus_in(xcb_generic_event_t *ge)
@@ -578,21 +980,10 @@ void on_focus_in(xcb_generic_event_t *ge)
 
   if ((c = cln_from_tab(e->event))) {
     cln_set_focus(c);
-    mon_draw_bar(fm);
+    mon_invalidate(fm, DirtyBar);
   }
 }
 
-void on_expose(xcb_generic_event_t *ge)
-{
-  xcb_expose_event_t *e = (xcb_expose_event_t *)ge;
-  client_t *c;
-
-  if (e->window == fm->barwin)
-    mon_draw_bar(fm);
-  else if ((c = cln_from_frame(e->window)))
-    cln_draw_tabs(c);
-}
-
 void on_destroy_notify(xcb_generic_event_t *ge)
 {
   xcb_destroy_notify_event_t *e = (xcb_destroy_notify_event_t *)ge;
@@ -603,11 +994,15 @@ void on_destroy_notify(xcb_generic_event_t *ge)
   if (!c)
     return;
 
-  cln_detach_tab(c, e->window);
+  cln_remove_tab(c, e->window);
   if (c->nt == 0)
     cln_unmanage(c);
-  else
+  else if (c == fc)
     bn_focus_tab(&arg);
+  else {
+    cln_sync_tabs(c);
+    cln_draw_tabs(c);
+  }
 }
 
 void on_unmap_notify(xcb_generic_event_t *ge)
@@ -615,35 +1010,45 @@ void on_unmap_notify(xcb_generic_event_t *ge)
   xcb_unmap_notify_event_t *e = (xcb_unmap_notify_event_t *)ge;
   client_t *c;
   arg_t arg = { .p = This };
+  int i;
   LOGV("on_unmap_notify: %d\n", e->window)
 
-  if ((c = cln_from_tab(e->window))) {
-    cln_detach_tab(c, e->window);
-    win_set_state(e->window, XCB_ICCCM_WM_STATE_WITHDRAWN);
+  if ((c = wmap_lookup(e->window, RoleTab, &i))) {
+    // unmaps of our own doing are not withdrawals, synthetic ones always are
+    if (!(e->response_type & 0x80) && c->tab[i].unmaps > 0) {
+      c->tab[i].unmaps--;
+      return;
+    }
+    cln_set_state(&c->tab[i], XCB_ICCCM_WM_STATE_WITHDRAWN);
+    cln_remove_tab(c, e->window);
     xcb_change_save_set(sn.conn, XCB_SET_MODE_DELETE, e->window);
     LOGI("window %d deleted from save set\n", e->window)
     if (c->nt == 0)
       cln_unmanage(c);
-    else
+    else if (c == fc)
       bn_focus_tab(&arg);
+    else {
+      cln_sync_tabs(c);
+      cln_draw_tabs(c);
+    }
   }
 }
 
+// the window attributes are requested last, their reply implies
+// the replies of cln_manage_request have arrived as well
 void on_map_request(xcb_generic_event_t *ge)
 {
   xcb_map_request_event_t *e = (xcb_map_request_event_t *)ge;
-  client_t *c;
-  bool override_redirect;
+  xcb_get_window_attributes_cookie_t wac;
+  manage_req_t *mr;
   LOGV("on_map_request: %d\n", e->window)
 
-  win_get_attr(e->window, &override_redirect, NULL);
-
-  if (override_redirect)
+  if (cln_from_tab(e->window))
     return;
-  if (!(c = cln_from_tab(e->window))) {
-    cln_manage(e->window);
-    xcb_flush(sn.conn);
-  }
+  mr = xmalloc(sizeof(manage_req_t));
+  cln_manage_request(mr, e->window);
+  wac = xcb_get_window_attributes(sn.conn, e->window);
+  async_push(wac.sequence, on_manage_attr, e->window, mr, cln_manage_drop);
 }
 
 void on_configure_request(xcb_generic_event_t *ge)
@@ -651,10 +1056,11 @@ void on_configure_request(xcb_generic_event_t *ge)
   xcb_configure_request_event_t *e = (xcb_configure_request_event_t *)ge;
   client_t *c;
   int x, y, w, h;
+  bool resized = false;
   LOGV("on_configure_request: %d\n", e->window)
 
   if ((c = cln_from_tab(e->window)) && c->isfloating) {
-    assert(e->window == c->tab[c->ft] && "configured window is not focus tab");
+    assert(e->window == c->tab[c->ft].win && "configured window is not focus tab");
     x = c->x;
     y = c->y;
     w = c->w;
@@ -670,29 +1076,33 @@ void on_configure_request(xcb_generic_event_t *ge)
     if (e->value_mask & XCB_CONFIG_WINDOW_HEIGHT)
       h = e->height;
     if (e->value_mask & (XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT))
-      cln_resize(c, w, h);
+      resized = cln_resize(c, w, h);
+    // the tab is not resized by the server, let it know where it is (ICCCM 4.1.5)
+    if (!resized)
+      win_send_configure(e->window, c->sx + c->sbw, c->sy + c->sbw + VXWM_TAB_HEIGHT,
+                         c->tab[c->ft].w, c->tab[c->ft].h, 0);
   } else if (!c)
     grant_configure_request(e);
-  xcb_flush(sn.conn);
 }
 
 void on_property_notify(xcb_generic_event_t *ge)
 {
   xcb_property_notify_event_t *e = (xcb_property_notify_event_t *)ge;
   client_t *c;
+  int i;
   LOGV("on_property_notify: %d @ %d\n", e->window, e->sequence)
 
   if (e->window == sn.root && e->atom == XCB_ATOM_WM_NAME) {
-    win_get_text_prop(sn.root, XCB_ATOM_WM_NAME, root_name, VXWM_ROOT_NAME_BUF);
-    mon_draw_bar(fm);
-  } else if ((c = cln_from_tab(e->window))) {
+    win_req_text_prop(sn.root, XCB_ATOM_WM_NAME, on_root_name, NULL);
+  } else if ((c = wmap_lookup(e->window, RoleTab, &i))) {
+    // titles nobody sees are only marked, they are fetched once shown or in the background
     if (e->atom == XCB_ATOM_WM_NAME || e->atom == sn.net_atom[NetWmName]) {
-      cln_update_title(c, e->window);
-      if (c == fc)
-        mon_draw_bar(fm);
-    }
+      cln_stale_title(&c->tab[i]);
+      if (c == fc && i == c->ft)
+        cln_fetch_title(&c->tab[i]);
+    } else if (win_props_index(e->atom) >= 0)
+      win_req_prop(e->window, e->atom, on_tab_prop);
   }
-  xcb_flush(sn.conn);
 }
 
 void on_client_message(xcb_generic_event_t *ge)
@@ -711,13 +1121,57 @@ void on_client_message(xcb_generic_event_t *ge)
              (e->data.data32[0] == NET_WM_STATE_TOGGLE && !c->isfullscr);
       if (!(c->isfullscr = state))
         cln_set_fullscr(fc, false);
-      mon_arrange(fm);
-      cln_set_focus(c);
+      mon_invalidate(fm, DirtyLayout);
+      mon_refocus(fm, c);
     }
-    xcb_flush(sn.conn);
   }
 }
 
+void on_root_name(void *reply, UNUSED xcb_window_t win, UNUSED void *data)
+{
+  if (win_text_from_reply(reply, root_name, VXWM_ROOT_NAME_BUF))
+    mon_invalidate(fm, DirtyBar);
+}
+
+// prefer _NET_WM_NAME and fall back to WM_NAME if the window does not set it
+void on_net_wm_name(void *reply, xcb_window_t win, UNUSED void *data)
+{
+  if (!cln_update_title(win, reply))
+    win_req_text_prop(win, XCB_ATOM_WM_NAME, on_wm_name, NULL);
+}
+
+void on_wm_name(void *reply, xcb_window_t win, UNUSED void *data)
+{
+  cln_update_title(win, reply);
+}
+
+// refresh a cached property of a tab, data is the property atom
+void on_tab_prop(void *reply, xcb_window_t win, void *data)
+{
+  client_t *c;
+  int i;
+
+  if ((c = wmap_lookup(win, RoleTab, &i)))
+    win_props_update(&c->tab[i].props, (xcb_atom_t)(uintptr_t)data, reply);
+}
+
+void on_manage_attr(void *reply, xcb_window_t win, void *data)
+{
+  xcb_get_window_attributes_reply_t *war = reply;
+  manage_req_t *mr = data;
+  client_t *c;
+
+  // the window may have been destroyed or managed since it was requested
+  if (!war || war->override_redirect || cln_from_tab(win)) {
+    cln_manage_cancel(mr);
+  } else {
+    c = cln_manage(mr);
+    mon_invalidate(fm, DirtyLayout);
+    mon_refocus(fm, c);
+  }
+  xfree(mr);
+}
+
 monitor_t *mon_create(void)
 {
   monitor_t *m;
@@ -725,6 +1179,8 @@ monitor_t *mon_create(void)
   m = xmalloc(sizeof(monitor_t));
   m->next = NULL;
   m->cln = NULL;
+  memset(m->ph, 0, sizeof(m->ph));
+  memset(m->pt, 0, sizeof(m->pt));
   m->np = LENGTH(pages);
   m->fp = 0;
   m->lx = 0;
@@ -733,11 +1189,13 @@ monitor_t *mon_create(void)
   m->lh = sn.scr->height_in_pixels - m->ly - barh;
   m->barwin = xcb_generate_id(sn.conn);
   m->barh = barh;
+  m->barpix = XCB_NONE;
+  m->dirty = 0;
+  m->nf = NULL;
   memset(m->lt_status, 0, VXWM_LT_STATUS_BUF);
 
-  masks = XCB_CW_OVERRIDE_REDIRECT | XCB_CW_EVENT_MASK;
+  masks = XCB_CW_OVERRIDE_REDIRECT;
   vals[0] = 1;
-  vals[1] = XCB_EVENT_MASK_EXPOSURE;
   xcb_create_window(sn.conn, sn.scr->root_depth, m->barwin, sn.root,
                     0, m->lh, sn.scr->width_in_pixels, barh, 0,
                     XCB_WINDOW_CLASS_INPUT_OUTPUT, sn.scr->root_visual, masks, vals);
@@ -750,12 +1208,60 @@ void mon_delete(monitor_t *m)
   // xassert(!m->cln && "deleting a monitor with clients");
   xcb_unmap_window(sn.conn, m->barwin);
   xcb_destroy_window(sn.conn, m->barwin);
+  if (m->barpix != XCB_NONE)
+    xcb_free_pixmap(sn.conn, m->barpix);
   xfree(m);
 }
 
+/// Defers work on a monitor to its next commit.
+/// @param reasons any of DirtyLayout, DirtyBar
+INLINE
+void mon_invalidate(monitor_t *m, uint32_t reasons)
+{
+  m->dirty |= reasons;
+}
+
+/// Focuses a client at the next commit, once the monitor is arranged.
+/// A fullscreen client granted focus by the arrangement keeps it.
+INLINE
+void mon_refocus(monitor_t *m, client_t *c)
+{
+  m->dirty |= DirtyFocus;
+  m->nf = c;
+}
+
+/// Carries out the work deferred since the last commit, the event loop commits
+/// once per batch of events so that each arrangement and bar repaint runs once.
+/// Committing defers nothing new, events drained while focusing join the batch.
+void mon_commit(monitor_t *m)
+{
+  UNUSED int nlayout = 0, nbar = 0;
+  uint32_t dirty = m->dirty;
+
+  m->dirty = 0;
+  if (dirty & DirtyLayout) {
+    nlayout++;
+    dirty |= DirtyBar; // layout status
+    if (mon_arrange(m))
+      dirty &= ~DirtyFocus;
+  }
+  if (dirty & DirtyFocus)
+    cln_set_focus(m->nf);
+  if (dirty & DirtyBar) {
+    nbar++;
+    mon_draw_bar(m);
+  }
+  m->nf = NULL;
+  if (nlayout + nbar > 0) {
+    update_client_list();
+    LOGI("committed %d arrangement(s) and %d bar repaint(s)\n", nlayout, nbar)
+  }
+}
+
 // TODO: arranging non-focus monitor will yield bugs since INPAGE references the focus monitor,
 //       doesn't matter fow now but remember to update this once we have multi-monitor support
-void mon_arrange(monitor_t *m)
+// @return true if a fullscreen client was granted focus
+bool mon_arrange(monitor_t *m)
 {
   layout_arg_t arg;
   client_t *c;
@@ -763,79 +1269,149 @@ void mon_arrange(monitor_t *m)
   arg.mon = m;
   arg.par = pages[m->fp].par;
   arg.ntiled = 0;
-  for (c = next_inpage(m->cln); c; c = next_inpage(c->next)) {
+  for (c = first_inpage(m); c; c = next_inpage(c)) {
     // due to the tagging mechanism, there can be multiple clients in the same page
     // that wishes fullscreen, only the first one is granted fullscreen and focus
     if (c->isfullscr) {
       cln_set_fullscr(c, true);
       cln_set_focus(c);
-      xcb_flush(sn.conn);
-      return;
+      return true;
     }
-    // restack and count tiled clients in focus page
-    if (!c->isfloating) {
-      win_stack(c->frame, Bottom);
+    // count tiled clients in focus page
+    if (!c->isfloating)
       arg.ntiled++;
-    }
   }
 
+  // tiled clients go below floating ones
+  UNUSED int n = stack_sink(is_tiled_frame);
+  LOGV("restacked %d frame(s)\n", n)
+
   // the layout may modify page parameters as they see fit
   memset(m->lt_status, 0, VXWM_LT_STATUS_BUF);
   if (arg.ntiled > 0)
     pages[m->fp].lt(&arg);
-  xcb_flush(sn.conn);
   LOGI("arranged page %s\n", pages[m->fp].sym)
+  return false;
 }
 
+// Lays out the status bar segments and redraws those whose span or key changed,
+// along with any segment overlapping the damage. Only the damaged span is
+// copied into the bar pixmap, which the server repaints the bar from.
 void mon_draw_bar(monitor_t *m)
 {
   const color_t fg = 0xCCCCCC;
   const color_t bg = 0x333333;
+  bar_seg_t seg[SegCount];
+  bool redraw[SegCount] = { false };
   int i, n, x, tw, pad = 28, sw = sn.scr->width_in_pixels;
-  LOGV("drawing status bar\n")
+  int d0 = sw, d1 = 0;
+  bool grown;
 
-  draw_rect_filled(0, 0, sw, fm->barh, bg);
-
-  // draw page symbols
+  // page symbols, the key holds the focus page and the focus client tags
   n = LENGTH(pages);
-  for (i = 0, x = 0; i < n; i++, x += tw) {
+  for (i = 0, x = 0; i < n; i++, x += tw + pad)
     draw_text_extents(pages[i].sym, &tw, NULL);
-    tw += pad;
-    if (i == m->fp) {
-      draw_rect_filled(x, 0, tw, fm->barh, fg);
-      draw_text(x, 0, tw, fm->barh, pages[i].sym, bg, pad / 2);
-    } else {
-      draw_text(x, 0, tw, fm->barh, pages[i].sym, fg, pad / 2);
-      if (fc && (LSB(i) & fc->tag))
-        draw_rect_filled(x + 5, 5, 5, 5, fg);
-    }
-  }
+  seg[SegPages] = (bar_seg_t){ 0, x, (uint64_t)(fc ? fc->tag : 0) << 32 | m->fp };
   pad = 8;
 
-  // draw layout status
+  // layout status
+  tw = 0;
   if (m->lt_status[0]) {
     draw_text_extents(m->lt_status, &tw, NULL);
     tw += pad;
-    draw_text(x, 0, tw, fm->barh, m->lt_status, fg, pad / 2);
-    x += tw;
   }
+  seg[SegStatus] = (bar_seg_t){ x, tw, hash_str(m->lt_status, strlen(m->lt_status)) };
+  x += tw;
 
-  // draw focus tab title
+  // focus tab title, a stale one is redrawn once fetched
+  seg[SegTitle] = (bar_seg_t){ 0, 0, 0 };
   if (fc) {
+    cln_fetch_title(&fc->tab[fc->ft]);
     x = MAX(x, sw / 2);
-    draw_text_extents(fc->name[fc->ft], &tw, NULL);
-    draw_text(x - tw / 2, 0, tw, fm->barh, fc->name[fc->ft], fg, 0);
+    draw_text_extents(fc->tab[fc->ft].name, &tw, NULL);
+    seg[SegTitle] = (bar_seg_t){ x - tw / 2, tw,
+                                 hash_str(fc->tab[fc->ft].name, strlen(fc->tab[fc->ft].name)) };
   }
 
-  // draw root window title
+  // root window title
   draw_text_extents(root_name, &tw, NULL);
   tw += pad;
-  x = sn.scr->width_in_pixels - tw;
-  draw_rect_filled(x, 0, tw, fm->barh, fg);
-  draw_arc_filled(x, fm->barh/2, fm->barh/2., 90, 270, fg);
-  draw_text(x, 0, tw, fm->barh, root_name, bg, pad / 2);
+  seg[SegRoot] = (bar_seg_t){ sw - tw, tw, hash_str(root_name, strlen(root_name)) };
+
+  // damage spans both the old and new extent of changed segments
+  if (m->barpix == XCB_NONE) {
+    m->barpix = xcb_generate_id(sn.conn);
+    xcb_create_pixmap(sn.conn, sn.scr->root_depth, m->barpix, m->barwin, sw, m->barh);
+    d0 = 0;
+    d1 = sw;
+  } else for (i = 0; i < SegCount; i++) {
+    if (seg[i].x == m->seg[i].x && seg[i].w == m->seg[i].w && seg[i].key == m->seg[i].key)
+      continue;
+    if (m->seg[i].w > 0) {
+      d0 = MIN(d0, m->seg[i].x);
+      d1 = MAX(d1, m->seg[i].x + m->seg[i].w);
+    }
+    if (seg[i].w > 0) {
+      d0 = MIN(d0, seg[i].x);
+      d1 = MAX(d1, seg[i].x + seg[i].w);
+    }
+  }
+  memcpy(m->seg, seg, sizeof(seg));
+  if (d0 >= d1) {
+    LOGV("status bar unchanged\n")
+    return;
+  }
 
-  draw_copy(m->barwin, 0, 0, sn.scr->width_in_pixels, fm->barh);
+  // segments are drawn whole, so the damage grows over every one it touches
+  do {
+    grown = false;
+    for (i = 0; i < SegCount; i++)
+      if (!redraw[i] && seg[i].w > 0 && seg[i].x < d1 && seg[i].x + seg[i].w > d0) {
+        redraw[i] = true;
+        grown = grown || seg[i].x < d0 || seg[i].x + seg[i].w > d1;
+        d0 = MIN(d0, seg[i].x);
+        d1 = MAX(d1, seg[i].x + seg[i].w);
+      }
+  } while (grown);
+  d0 = MAX(d0, 0);
+  d1 = MIN(d1, sw);
+
+  draw_begin(sw, m->barh);
+  draw_rect_filled(d0, 0, d1 - d0, m->barh, bg);
+  if (redraw[SegPages]) {
+    pad = 28;
+    for (i = 0, x = 0; i < n; i++, x += tw) {
+      draw_text_extents(pages[i].sym, &tw, NULL);
+      tw += pad;
+      if (i == m->fp) {
+        draw_rect_filled(x, 0, tw, m->barh, fg);
+        draw_text(x, 0, tw, m->barh, pages[i].sym, bg, pad / 2);
+      } else {
+        draw_text(x, 0, tw, m->barh, pages[i].sym, fg, pad / 2);
+        if (fc && (LSB(i) & fc->tag))
+          draw_rect_filled(x + 5, 5, 5, 5, fg);
+      }
+    }
+    pad = 8;
+  }
+  if (redraw[SegStatus])
+    draw_text(seg[SegStatus].x, 0, seg[SegStatus].w, m->barh, m->lt_status, fg, pad / 2);
+  if (redraw[SegTitle])
+    draw_text(seg[SegTitle].x, 0, seg[SegTitle].w, m->barh, fc->tab[fc->ft].name, fg, 0);
+  if (redraw[SegRoot]) {
+    x = seg[SegRoot].x;
+    draw_rect_filled(x, 0, seg[SegRoot].w, m->barh, fg);
+    draw_arc_filled(x, m->barh/2, m->barh/2., 90, 270, fg);
+    draw_text(x, 0, seg[SegRoot].w, m->barh, root_name, bg, pad / 2);
+  }
+  LOGI("status bar redrew%s%s%s%s, %d of %d px copied\n",
+       redraw[SegPages] ? " pages" : "", redraw[SegStatus] ? " status" : "",
+       redraw[SegTitle] ? " title" : "", redraw[SegRoot] ? " root" : "", d1 - d0, sw)
+
+  // the server may have copied the previous contents, so set it again
+  draw_copy(m->barpix, d0, 0, d1 - d0, m->barh);
+  xcb_change_window_attributes(sn.conn, m->barwin, XCB_CW_BACK_PIXMAP, &m->barpix);
+  xcb_clear_area(sn.conn, 0, m->barwin, d0, 0, d1 - d0, m->barh);
 }
 
 client_t *cln_create()
@@ -843,13 +1419,13 @@ client_t *cln_create()
   assert(fm && "no focus monitor");
   client_t *c;
 
-  c = xmalloc(sizeof(client_t));
+  c = pool_get(&cln_pool);
   c->next = NULL;
-  c->tab = xmalloc(sizeof(xcb_window_t));
-  c->name = xmalloc(VXWM_TAB_NAME_BUF);
+  memset(c->pl, 0, sizeof(c->pl));
+  c->tcls = 0;
+  c->tab = tabs_get(c->tcls);
   c->tag = LSB(fm->fp);
   c->sel = 0;
-  c->tcap = 1;
   c->nt = 0;
   c->ft = 0;
   c->isfloating = false;
@@ -858,48 +1434,92 @@ client_t *cln_create()
   c->y = c->py = 0;
   c->w = c->pw = VXWM_CLN_MIN_W;
   c->h = c->ph = VXWM_CLN_MIN_H;
-  memset(c->name, 0, VXWM_TAB_NAME_BUF);
+  c->strip = XCB_NONE;
+  c->stw = 0;
 
   cln_frame(c);
   return c;
 }
 
-void cln_manage(xcb_window_t win)
+// send every request needed to manage a window without waiting for replies
+void cln_manage_request(manage_req_t *mr, xcb_window_t win)
 {
+  mr->win = win;
+  mr->net_name = xcb_icccm_get_text_property(sn.conn, win, sn.net_atom[NetWmName]);
+  mr->name = xcb_icccm_get_text_property(sn.conn, win, XCB_ATOM_WM_NAME);
+  win_props_request(win, mr->prop);
+  mr->geom = xcb_get_geometry(sn.conn, win);
+}
+
+void cln_manage_cancel(manage_req_t *mr)
+{
+  int i;
+
+  xcb_discard_reply(sn.conn, mr->net_name.sequence);
+  xcb_discard_reply(sn.conn, mr->name.sequence);
+  for (i = 0; i < WinPropsCount; i++)
+    xcb_discard_reply(sn.conn, mr->prop[i].sequence);
+  xcb_discard_reply(sn.conn, mr->geom.sequence);
+}
+
+// releases a request whose window was never managed, on_manage_attr did not run
+void cln_manage_drop(void *data)
+{
+  cln_manage_cancel(data);
+  xfree(data);
+}
+
+// collect replies from cln_manage_request and adopt the window as a new client,
+// arranging the monitor and focusing the client is left to the caller
+client_t *cln_manage(manage_req_t *mr)
+{
+  xcb_get_property_reply_t *npr, *pr;
+  xcb_get_geometry_reply_t *gr;
+  win_props_t *props;
+  const char *text;
+  uint32_t len;
+  tab_t t = { .win = mr->win, .w = -1, .h = -1, .unmaps = 0, .ismapped = false, .isstale = false,
+              .state = XCB_ICCCM_WM_STATE_WITHDRAWN };
   client_t *c;
-  xcb_atom_t win_type;
-  int x, y, w, h;
 
-  xcb_change_save_set(sn.conn, XCB_SET_MODE_INSERT, win);
-  LOGI("window %d added to save set\n", win)
+  npr = xcb_get_property_reply(sn.conn, mr->net_name, NULL);
+  pr = xcb_get_property_reply(sn.conn, mr->name, NULL);
+  if (!(text = win_text_view(npr, &len)) && !(text = win_text_view(pr, &len))) {
+    text = "";
+    len = 0;
+  }
+  t.name = intern(text, len);
+  win_props_reply(mr->prop, &t.props);
+  gr = xcb_get_geometry_reply(sn.conn, mr->geom, NULL);
+
+  xcb_change_save_set(sn.conn, XCB_SET_MODE_INSERT, mr->win);
+  LOGI("window %d added to save set\n", mr->win)
 
   c = cln_create();
-  cln_attach_tab(c, win);
+  cln_attach_tab(c, &t);
   cln_attach(c);
 
-  xcb_map_window(sn.conn, win);
-  if (win_get_atom_prop(c->tab[c->ft], sn.net_atom[NetWmWindowType], &win_type) &&
-      win_type == sn.net_atom[NetWmWindowTypeDialog])
+  cln_map_tab(&c->tab[c->ft], true);
+  props = &c->tab[c->ft].props;
+  if (props->type == sn.net_atom[NetWmWindowTypeDialog])
     c->isfloating = true;
 
-  if (c->isfloating) {
-    win_get_geometry(win, &x, &y, &w, &h, NULL);
-    cln_move_resize(c, x, y, w, h);
-  }
+  if (c->isfloating && gr)
+    cln_move_resize(c, gr->x, gr->y, gr->width, gr->height);
 
-  win_set_state(win, XCB_ICCCM_WM_STATE_NORMAL);
-  mon_arrange(fm);
-  cln_set_focus(c);
-  mon_draw_bar(fm);
+  xfree(gr);
+  xfree(pr);
+  xfree(npr);
+  return c;
 }
 
 void cln_delete(client_t *c)
 {
+  if (c->strip != XCB_NONE) // a reused frame gets the strip of its next client
+    xcb_free_pixmap(sn.conn, c->strip);
   cln_unframe(c);
-  xcb_flush(sn.conn);
-  xfree(c->tab);
-  xfree(c->name);
-  xfree(c);
+  tabs_put(c->tab, c->tcls);
+  pool_put(&cln_pool, c);
 }
 
 void cln_unmanage(client_t *c)
@@ -910,18 +1530,50 @@ void cln_unmanage(client_t *c)
   fb = cln_focus_fallback(c);
   cln_detach(c);
   cln_delete(c);
-  mon_arrange(fm);
-  cln_set_focus(fb);
-  mon_draw_bar(fm);
+  mon_invalidate(fm, DirtyLayout);
+  mon_refocus(fm, fb);
 }
 
 void cln_set_border(client_t *c, int width)
 {
-  masks = XCB_CONFIG_WINDOW_BORDER_WIDTH;
-  xcb_configure_window(sn.conn, c->frame, masks, &width);
+  cln_configure_frame(c, c->sx, c->sy, c->sw, c->sh, width);
 }
 
+// Gives a client a mapped frame on top of all others, reusing a released
+// frame when one is left.
 void cln_frame(client_t *c)
+{
+  frame_t *f;
+
+  if (nspare > 0) {
+    f = &spare[--nspare];
+    c->frame = f->win;
+    c->tabbar = f->tabbar;
+    c->sx = f->x;
+    c->sy = f->y;
+    c->sw = f->w;
+    c->sh = f->h;
+    c->sbw = VXWM_CLN_BORDER_W;
+    // a frame released while fullscreen has lost its border
+    if (f->bw != VXWM_CLN_BORDER_W) {
+      vals[0] = VXWM_CLN_BORDER_W;
+      vals[1] = XCB_STACK_MODE_ABOVE;
+      xcb_configure_window(sn.conn, c->frame,
+                           XCB_CONFIG_WINDOW_BORDER_WIDTH | XCB_CONFIG_WINDOW_STACK_MODE, vals);
+    } else {
+      vals[0] = XCB_STACK_MODE_ABOVE;
+      xcb_configure_window(sn.conn, c->frame, XCB_CONFIG_WINDOW_STACK_MODE, vals);
+    }
+    LOGV("reused client frame: %d\n", c->frame)
+  } else
+    cln_create_frame(c);
+  xcb_map_window(sn.conn, c->frame);
+  c->ismapped = true;
+  stack_push(c->frame);
+  wmap_insert(c->frame, c, RoleFrame, 0);
+}
+
+void cln_create_frame(client_t *c)
 {
   int i, n;
 
@@ -936,6 +1588,17 @@ void cln_frame(client_t *c)
                     c->frame, sn.root, 0, 0, VXWM_CLN_MIN_W, VXWM_CLN_MIN_H,
                     VXWM_CLN_BORDER_W, XCB_WINDOW_CLASS_INPUT_OUTPUT,
                     sn.scr->root_visual, masks, vals);
+  c->sx = c->sy = 0;
+  c->sw = VXWM_CLN_MIN_W;
+  c->sh = VXWM_CLN_MIN_H;
+  c->sbw = VXWM_CLN_BORDER_W;
+
+  // selects no events, so clicks on the strip go to the frame
+  c->tabbar = xcb_generate_id(sn.conn);
+  xcb_create_window(sn.conn, XCB_COPY_FROM_PARENT, c->tabbar, c->frame, 0, 0,
+                    VXWM_CLN_MIN_W, VXWM_TAB_HEIGHT, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                    XCB_COPY_FROM_PARENT, 0, NULL);
+  xcb_map_window(sn.conn, c->tabbar);
 
   masks = XCB_EVENT_MASK_BUTTON_PRESS |
           XCB_EVENT_MASK_BUTTON_RELEASE |
@@ -943,34 +1606,98 @@ void cln_frame(client_t *c)
   for (i = 0, n = LENGTH(btnbinds); i < n; i++)
     xcb_grab_button(sn.conn, 0, c->frame, masks, XCB_GRAB_MODE_ASYNC, XCB_GRAB_MODE_ASYNC,
                     XCB_NONE, XCB_NONE, btnbinds[i].btn, btnbinds[i].mod);
-  xcb_map_window(sn.conn, c->frame);
   LOGV("created client frame: %d\n", c->frame)
 }
 
+// Releases the frame of a client without tabs. Up to VXWM_FRAME_SPARE frames
+// are unmapped and kept for reuse, only frames beyond that are destroyed.
 void cln_unframe(client_t *c)
 {
+  uint32_t nclr = VXWM_CLN_NORMAL_CLR;
+
+  wmap_remove(c->frame);
+  stack_remove(c->frame);
+  if (nspare < VXWM_FRAME_SPARE) {
+    if (c->ismapped)
+      xcb_unmap_window(sn.conn, c->frame);
+    // the focus border is only reset while a client has tabs, and the focus
+    // is already gone by now, so a parked frame may still carry it
+    xcb_change_window_attributes(sn.conn, c->frame, XCB_CW_BORDER_PIXEL, &nclr);
+    spare[nspare++] = (frame_t){ c->frame, c->tabbar, c->sx, c->sy, c->sw, c->sh, c->sbw };
+    LOGV("released client frame: %d (%d spare)\n", c->frame, nspare)
+    return;
+  }
   xcb_unmap_window(sn.conn, c->frame);
   xcb_destroy_window(sn.conn, c->frame);
   LOGV("destroyed client frame: %d\n", c->frame)
 }
 
+/// Attaches a client to the focus monitor, it comes first in each of its pages.
 void cln_attach(client_t *c)
 {
+  int i;
+
   c->next = fm->cln;
   fm->cln = c;
+  for (i = 0; i < fm->np; i++)
+    if (c->tag & LSB(i))
+      cln_link_page(c, i, NULL);
 }
 
 void cln_detach(client_t *c)
 {
   client_t **cc;
+  int i;
+
+  // neither the focus nor a pending focus may outlive the client, its storage
+  // is handed to the next client created
+  if (fm->nf == c)
+    fm->nf = cln_focus_fallback(c);
+  if (fc == c)
+    fc = NULL;
   for (cc = &fm->cln; *cc && *cc != c; cc = &(*cc)->next) ;
   *cc = c->next;
+  for (i = 0; i < fm->np; i++)
+    if (c->tag & LSB(i))
+      cln_unlink_page(c, i);
+}
+
+/// Links a client into the list of a page.
+/// @param after the client to follow, NULL to come first
+void cln_link_page(client_t *c, int page, client_t *after)
+{
+  client_t *next = after ? after->pl[page].next : fm->ph[page];
+
+  c->pl[page].prev = after;
+  c->pl[page].next = next;
+  if (after)
+    after->pl[page].next = c;
+  else
+    fm->ph[page] = c;
+  if (next)
+    next->pl[page].prev = c;
+  else
+    fm->pt[page] = c;
+}
+
+void cln_unlink_page(client_t *c, int page)
+{
+  plink_t *l = &c->pl[page];
+
+  if (l->prev)
+    l->prev->pl[page].next = l->next;
+  else
+    fm->ph[page] = l->next;
+  if (l->next)
+    l->next->pl[page].prev = l->prev;
+  else
+    fm->pt[page] = l->prev;
+  l->prev = l->next = NULL;
 }
 
 void cln_set_focus(client_t *c)
 {
   xcb_generic_event_t *ge;
-  uint8_t type;
   uint32_t fclr = VXWM_CLN_FOCUS_CLR;
   uint32_t nclr = VXWM_CLN_NORMAL_CLR;
   client_t *pf = NULL;
@@ -989,34 +1716,35 @@ void cln_set_focus(client_t *c)
   // assign new focus client or loose focus
   if ((fc = c)) {
     xcb_change_window_attributes(sn.conn, fc->frame, XCB_CW_BORDER_PIXEL, &fclr);
-    win_focus(fc->tab[fc->ft]);
+    win_focus(fc->tab[fc->ft].win, &fc->tab[fc->ft].props);
     cln_draw_tabs(fc);
-    LOGI("new focus: %d (%d)\n", fc->tab[fc->ft], fc->frame)
+    LOGI("new focus: %d (%d)\n", fc->tab[fc->ft].win, fc->frame)
   } else {
-    win_focus(sn.root);
+    win_focus(sn.root, NULL);
     LOGI("loosing focus\n")
   }
 
-  // ignore remaining enter notify events in local event queue
+  // ignore remaining enter notify events in local event queue, the others
+  // join the batch behind the events that arrived before them
   while ((ge = xcb_poll_for_queued_event(sn.conn))) {
-    type = XCB_EVENT_RESPONSE_TYPE(ge);
-    if (type != XCB_ENTER_NOTIFY && handler[type])
-      handler[type](ge);
-    xfree(ge);
+    if (XCB_EVENT_RESPONSE_TYPE(ge) == XCB_ENTER_NOTIFY)
+      xfree(ge);
+    else
+      batch_push(ge);
   }
 }
 
 INLINE
 void cln_raise(client_t *c)
 {
-  win_stack(c->frame, Top);
+  stack_raise(c->frame);
   cln_draw_tabs(c);
 }
 
 void cln_set_fullscr(client_t *c, bool fullscr)
 {
   if (fullscr) {
-    win_stack(c->frame, Top);
+    stack_raise(c->frame);
     cln_set_border(c, 0);
     cln_move_resize(c, 0, 0, sn.scr->width_in_pixels, sn.scr->height_in_pixels);
   } else {
@@ -1025,16 +1753,30 @@ void cln_set_fullscr(client_t *c, bool fullscr)
   }
 }
 
-void cln_attach_tab(client_t *c, xcb_window_t win)
+// moves the tab array up the size classes until it holds n tabs, in one copy
+void cln_reserve_tabs(client_t *c, int n)
 {
-  if (c->nt == c->tcap) {
-    c->tcap <<= 1;
-    c->tab = xrealloc(c->tab, sizeof(xcb_window_t) * c->tcap);
-    c->name = xrealloc(c->name, VXWM_TAB_NAME_BUF * c->tcap);
-  }
+  tab_t *tab;
+  int cls = c->tcls;
 
-  c->tab[c->nt++] = win;
-  cln_update_title(c, win);
+  while (n > 1 << cls)
+    cls++;
+  if (cls == c->tcls)
+    return;
+  tab = tabs_get(cls);
+  memcpy(tab, c->tab, sizeof(tab_t) * c->nt);
+  tabs_put(c->tab, c->tcls);
+  c->tab = tab;
+  c->tcls = cls;
+}
+
+void cln_attach_tab(client_t *c, const tab_t *t)
+{
+  xcb_window_t win = t->win;
+
+  cln_reserve_tabs(c, c->nt + 1);
+  c->tab[c->nt] = *t;
+  wmap_insert(win, c, RoleTab, c->nt++);
 
   // If the window is already mapped and has the structure notify event mask,
   // then reparenting generates an unmap notify on the reparented window.
@@ -1047,16 +1789,91 @@ void cln_attach_tab(client_t *c, xcb_window_t win)
   LOGV("attached %d under frame %d\n", win, c->frame)
 }
 
+// Appends a tab moved over from another client. Unlike a freshly managed
+// window its map state is known, so the unmap notify caused by reparenting a
+// mapped window is simply counted as our own instead of masking events around
+// the reparent, leaving a single request per tab. The server maps the window
+// again under the new frame, the caller syncs the tabs afterwards.
+void cln_adopt_tab(client_t *c, const tab_t *t)
+{
+  cln_reserve_tabs(c, c->nt + 1);
+  c->tab[c->nt] = *t;
+  if (t->ismapped)
+    c->tab[c->nt].unmaps++;
+  wmap_insert(t->win, c, RoleTab, c->nt++);
+  xcb_reparent_window(sn.conn, t->win, c->frame, 0, VXWM_TAB_HEIGHT);
+}
+
+/// Detaches a tab whose window is gone for good and releases its title.
+void cln_remove_tab(client_t *c, xcb_window_t win)
+{
+  int i;
+
+  if (wmap_lookup(win, RoleTab, &i) == c) {
+    if (c->tab[i].isstale)
+      nstale--;
+    intern_drop(c->tab[i].name);
+  }
+  cln_detach_tab(c, win);
+}
+
+/// Marks the title of a tab as changed, starting the background refresh period
+/// if no other title was waiting.
+void cln_stale_title(tab_t *t)
+{
+  if (t->isstale)
+    return;
+  t->isstale = true;
+  if (nstale++ == 0)
+    titles_due = time_ms() + VXWM_TITLE_REFRESH_MS;
+}
+
+// requests a stale title, the reply updates the tab and the bar if need be
+void cln_fetch_title(tab_t *t)
+{
+  if (!t->isstale)
+    return;
+  t->isstale = false;
+  nstale--;
+  win_req_text_prop(t->win, sn.net_atom[NetWmName], on_net_wm_name, NULL);
+}
+
+// fetches every stale title at once, rate limited by VXWM_TITLE_REFRESH_MS
+void cln_refresh_titles(monitor_t *m)
+{
+  client_t *c;
+  int i;
+
+  for (c = m->cln; c && nstale > 0; c = c->next)
+    for (i = 0; i < c->nt; i++)
+      cln_fetch_title(&c->tab[i]);
+  LOGV("refreshed stale titles\n")
+}
+
+// tab arrays come in power of two sizes, each from its own pool
+INLINE
+tab_t *tabs_get(int cls)
+{
+  assert(cls < VXWM_TAB_CLASSES && "tab array size class out of range");
+  return pool_get(&tab_pool[cls]);
+}
+
+INLINE
+void tabs_put(tab_t *tab, int cls)
+{
+  pool_put(&tab_pool[cls], tab);
+}
+
 void cln_detach_tab(client_t *c, xcb_window_t win)
 {
   uint32_t lsb_mask;
   int i;
 
-  for (i = 0; i < c->nt && c->tab[i] != win; i++) ;
-  if (i >= c->nt) {
+  if (wmap_lookup(win, RoleTab, &i) != c) {
     LOGW("window not found in cln_detach_tab\n")
     return;
   }
+  wmap_remove(win);
 
   // preserve selection mask
   if (c->sel & LSB(i))
@@ -1064,92 +1881,344 @@ void cln_detach_tab(client_t *c, xcb_window_t win)
   lsb_mask = LSB(i) - 1;
   c->sel = ((c->sel >> 1) & ~lsb_mask) + (c->sel & lsb_mask);
 
-  for (; i < c->nt - 1; i++)
+  for (; i < c->nt - 1; i++) {
     c->tab[i] = c->tab[i + 1];
+    wmap_insert(c->tab[i].win, c, RoleTab, i);
+  }
   c->nt--;
   c->ft = MAX(c->ft - 1, 0);
 }
 
-void cln_update_title(client_t *c, xcb_window_t win)
+// Drops the tabs in mask, which were adopted elsewhere, closing the gaps in a
+// single pass. Selection bits and window map indices follow their tabs, the
+// focus stays on its tab or falls back to the nearest remaining one before it.
+void cln_compact_tabs(client_t *c, uint64_t mask)
 {
-  int i;
+  uint64_t sel = 0;
+  int i, j, ft = 0;
 
-  for (i = 0; c->tab[i] != win && i < c->nt; i++) ;
-  assert(i != c->nt);
+  for (i = j = 0; i < c->nt; i++) {
+    if (mask & LSB(i)) {
+      if (c->sel & LSB(i))
+        nsel--;
+      if (i == c->ft)
+        ft = MAX(j - 1, 0);
+      continue;
+    }
+    if (c->sel & LSB(i))
+      sel |= LSB(j);
+    if (i == c->ft)
+      ft = j;
+    if (i != j) {
+      c->tab[j] = c->tab[i];
+      wmap_insert(c->tab[j].win, c, RoleTab, j);
+    }
+    j++;
+  }
+  c->nt = j;
+  c->sel = sel;
+  c->ft = ft;
+}
 
-  if (!win_get_text_prop(win, sn.net_atom[NetWmName], c->name[i], VXWM_TAB_NAME_BUF))
-    win_get_text_prop(win, XCB_ATOM_WM_NAME, c->name[i], VXWM_TAB_NAME_BUF);
+/// Moves the tabs in mask from one client to the end of another. The
+/// destination array is sized once and the source is compacted once, callers
+/// moving several sets hold a server grab so that other clients never observe
+/// a half moved selection.
+/// @return number of tabs moved
+int cln_transfer_tabs(client_t *src, uint64_t mask, client_t *dst)
+{
+  int i, n = 0;
+
+  assert(src != dst && "tabs transferred onto their own client");
+  for (i = 0; i < src->nt; i++)
+    if (mask & LSB(i))
+      n++;
+  if (n == 0)
+    return 0;
+
+  cln_reserve_tabs(dst, dst->nt + n);
+  for (i = 0; i < src->nt; i++)
+    if (mask & LSB(i))
+      cln_adopt_tab(dst, &src->tab[i]);
+  cln_compact_tabs(src, mask);
+  LOGV("transferred %d tab(s) from frame %d to frame %d\n", n, src->frame, dst->frame)
+  return n;
 }
 
+// apply a title property reply to the tab it was requested for
+// @return false if the reply holds no usable title
+bool cln_update_title(xcb_window_t win, xcb_get_property_reply_t *pr)
+{
+  const char *text, *old;
+  client_t *c;
+  uint32_t len;
+  int i;
+
+  if (!(c = wmap_lookup(win, RoleTab, &i)))
+    return true; // tab went away while the title was in flight
+  if (!(text = win_text_view(pr, &len)))
+    return false;
+  // interning an unchanged title yields the very same string
+  old = c->tab[i].name;
+  c->tab[i].name = intern(text, len);
+  if (c == fc && c->tab[i].name != old)
+    mon_invalidate(fm, DirtyBar);
+  intern_drop(old);
+  return true;
+}
+
+// Renders the tab strip into a pixmap of its own which becomes the background
+// of the tab bar, so the server repaints exposed strips without our help.
+// The tab bar only spans the strip, as a frame background it would tile
+// over the body. The strip is only rendered again when what it shows changed.
 void cln_draw_tabs(client_t *c)
 {
   int tw, sw, i;
 
   if (!c || c->nt == 0)
     return;
+  if (c->strip != XCB_NONE && c->stw == c->w && c->snt == c->nt && c->sft == c->ft &&
+      c->ssel == c->sel && c->sfocus == (c == fc))
+    return;
+  if (c->stw != c->w || c->strip == XCB_NONE) {
+    if (c->strip != XCB_NONE)
+      xcb_free_pixmap(sn.conn, c->strip);
+    c->strip = xcb_generate_id(sn.conn);
+    xcb_create_pixmap(sn.conn, sn.scr->root_depth, c->strip, c->frame, c->w, VXWM_TAB_HEIGHT);
+    if (c->stw != c->w) {
+      vals[0] = c->w;
+      xcb_configure_window(sn.conn, c->tabbar, XCB_CONFIG_WINDOW_WIDTH, vals);
+    }
+    c->stw = c->w;
+  }
+  c->snt = c->nt;
+  c->sft = c->ft;
+  c->ssel = c->sel;
+  c->sfocus = c == fc;
+
   tw = c->w / c->nt;
   sw = VXWM_TAB_HEIGHT / 2;
+  draw_begin(c->w, VXWM_TAB_HEIGHT);
   draw_rect_filled(0, 0, c->w, VXWM_TAB_HEIGHT, VXWM_TAB_NORMAL_CLR);
   if (c == fc)
     draw_rect_filled(tw * c->ft, 0, tw, VXWM_TAB_HEIGHT, VXWM_TAB_FOCUS_CLR);
   for (i = 0; i < c->nt; i++)
     if (c->sel & LSB(i))
       draw_rect_filled((i + 0.25) * tw, sw / 2, tw / 2, sw, VXWM_TAB_SELECT_CLR);
-  draw_copy(c->frame, 0, 0, c->w, VXWM_TAB_HEIGHT);
+  draw_copy(c->strip, 0, 0, c->w, VXWM_TAB_HEIGHT);
+
+  // the server may have copied the previous contents, so set it again
+  xcb_change_window_attributes(sn.conn, c->tabbar, XCB_CW_BACK_PIXMAP, &c->strip);
+  xcb_clear_area(sn.conn, 0, c->tabbar, 0, 0, 0, 0);
+}
+
+/// Configures the frame with the values that differ from what the server has.
+/// @return true if a request was sent
+bool cln_configure_frame(client_t *c, int x, int y, int w, int h, int bw)
+{
+  int i = 0;
+
+  masks = 0;
+  if (x != c->sx) {
+    masks |= XCB_CONFIG_WINDOW_X;
+    vals[i++] = c->sx = x;
+  }
+  if (y != c->sy) {
+    masks |= XCB_CONFIG_WINDOW_Y;
+    vals[i++] = c->sy = y;
+  }
+  if (w != c->sw) {
+    masks |= XCB_CONFIG_WINDOW_WIDTH;
+    vals[i++] = c->sw = w;
+    tabs_stale |= c->nt > 1;
+  }
+  if (h != c->sh) {
+    masks |= XCB_CONFIG_WINDOW_HEIGHT;
+    vals[i++] = c->sh = h;
+    tabs_stale |= c->nt > 1;
+  }
+  if (bw != c->sbw) {
+    masks |= XCB_CONFIG_WINDOW_BORDER_WIDTH;
+    vals[i++] = c->sbw = bw;
+  }
+  if (masks == 0)
+    return false;
+  xcb_configure_window(sn.conn, c->frame, masks, vals);
+  return true;
+}
+
+/// Sizes a tab to fill the client unless it already does,
+/// tabs keep their size while unfocused so refocusing them is free.
+/// @return true if the tab was resized
+bool cln_configure_tab(client_t *c, int i)
+{
+  tab_t *t = &c->tab[i];
+  int w = c->w, h = c->h - VXWM_TAB_HEIGHT;
+
+  if (t->w == w && t->h == h)
+    return false;
+  masks = XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT;
+  vals[0] = t->w = w;
+  vals[1] = t->h = h;
+  xcb_configure_window(sn.conn, t->win, masks, vals);
+  win_send_configure(t->win, c->sx + c->sbw, c->sy + c->sbw + VXWM_TAB_HEIGHT, w, h, 0);
+  return true;
+}
+
+// sends the client geometry to the frame, tabs are drawn to fit a new width
+INLINE
+void cln_commit_geometry(client_t *c)
+{
+  bool redraw = c->w != c->sw;
+
+  cln_configure_frame(c, c->x, c->y, c->w, c->h, c->sbw);
+  if (redraw)
+    cln_draw_tabs(c);
 }
 
 void cln_move(client_t *c, int x, int y)
 {
   c->px = c->x;
   c->py = c->y;
-  masks = XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y;
-  vals[0] = c->x = x;
-  vals[1] = c->y = y;
-  xcb_configure_window(sn.conn, c->frame, masks, vals);
+  c->x = x;
+  c->y = y;
+  cln_configure_frame(c, x, y, c->sw, c->sh, c->sbw);
 }
 
-void cln_resize(client_t *c, int w, int h)
+/// Resizes the client frame and its focus tab.
+/// @return true if the focus tab was resized
+bool cln_resize(client_t *c, int w, int h)
 {
   if (w < VXWM_CLN_MIN_W || h < VXWM_CLN_MIN_H)
-    return;
+    return false;
   c->pw = c->w;
   c->ph = c->h;
-  masks = XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT;
-  vals[0] = c->w = w;
-  vals[1] = c->h = h;
-  xcb_configure_window(sn.conn, c->frame, masks, vals);
-  vals[1] = c->h - VXWM_TAB_HEIGHT;
-  xcb_configure_window(sn.conn, c->tab[c->ft], masks, vals);
-  win_send_configure(c->tab[c->ft], 0, 0, vals[0], vals[1], 0);
-  cln_draw_tabs(c);
+  c->w = w;
+  c->h = h;
+  if (cln_configure_frame(c, c->sx, c->sy, w, h, c->sbw) && (masks & XCB_CONFIG_WINDOW_WIDTH))
+    cln_draw_tabs(c);
+  return cln_configure_tab(c, c->ft);
 }
 
+// moves and resizes with a single request to the frame
 INLINE
 void cln_move_resize(client_t *c, int x, int y, int w, int h)
 {
-  cln_move(c, x, y);
-  cln_resize(c, w, h);
+  c->px = c->x;
+  c->py = c->y;
+  c->x = x;
+  c->y = y;
+  if (w >= VXWM_CLN_MIN_W && h >= VXWM_CLN_MIN_H) {
+    c->pw = c->w;
+    c->ph = c->h;
+    c->w = w;
+    c->h = h;
+  }
+  cln_commit_geometry(c);
+  cln_configure_tab(c, c->ft);
+}
+
+/// Writes the WM_STATE of a tab unless it already holds that state, each write
+/// makes the client and any pager process a PropertyNotify.
+void cln_set_state(tab_t *t, uint32_t state)
+{
+  if (t->state == state)
+    return;
+  win_set_state(t->win, state);
+  t->state = state;
+  nprop++;
+}
+
+/// Maps or unmaps a tab window unless it already is,
+/// unmaps are counted so that on_unmap_notify can tell them from withdrawals.
+// since ICCCM does not explicitly define what "IconicState" is,
+// vxwm considers tabs that are not mapped to be "Iconic" since
+// these tab windows are unviewable but not withdrawn either.
+void cln_map_tab(tab_t *t, bool map)
+{
+  if (t->ismapped == map)
+    return;
+  if (map) {
+    xcb_map_window(sn.conn, t->win);
+    cln_set_state(t, XCB_ICCCM_WM_STATE_NORMAL);
+  } else {
+    xcb_unmap_window(sn.conn, t->win);
+    cln_set_state(t, XCB_ICCCM_WM_STATE_ICONIC);
+    t->unmaps++;
+  }
+  t->ismapped = map;
+}
+
+/// Leaves the focus tab of a mapped client as its only mapped tab, so that
+/// tabs in the background do not render. The focus tab is sized before it is
+/// mapped and mapped before the previous one goes away.
+void cln_sync_tabs(client_t *c)
+{
+  int i;
+
+  if (c->ismapped) {
+    cln_configure_tab(c, c->ft);
+    cln_map_tab(&c->tab[c->ft], true);
+  }
+  for (i = 0; i < c->nt; i++)
+    if (i != c->ft || !c->ismapped)
+      cln_map_tab(&c->tab[i], false);
+}
+
+/// Sizes the background tabs of visible clients to their client, so that
+/// switching to them later needs no configure while the user waits.
+/// Runs when the event loop is idle, background tabs are unmapped and
+/// reflowing them costs the applications nothing visible.
+void cln_presize_tabs(monitor_t *m)
+{
+  client_t *c;
+  UNUSED int n = 0;
+  int i;
+
+  tabs_stale = false;
+  for (c = m->cln; c; c = c->next)
+    if (c->ismapped)
+      for (i = 0; i < c->nt; i++)
+        if (i != c->ft && cln_configure_tab(c, i))
+          n++;
+  LOGV("pre-sized %d background tab(s)\n", n)
+}
+
+/// Maps or unmaps a client with all its tabs. Unmapped windows stop being
+/// viewable, so clients on hidden pages are told to stop rendering.
+void cln_map(client_t *c, bool map)
+{
+  if (c->ismapped == map)
+    return;
+  c->ismapped = map;
+  if (map) {
+    cln_sync_tabs(c);
+    xcb_map_window(sn.conn, c->frame);
+  } else {
+    xcb_unmap_window(sn.conn, c->frame);
+    cln_sync_tabs(c);
+  }
 }
 
+/// Maps the clients of the focus page and unmaps all others. Clients are shown
+/// before any is hidden, so the root window does not flash in between.
 void cln_show_hide(monitor_t *m)
 {
   client_t *c;
 
   for (c = m->cln; c; c = c->next)
     if (INPAGE(c))
-      cln_move_resize(c, c->x, c->y, c->w, c->h);
-    else {
-      masks = XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y;
-      vals[0] = sn.scr->width_in_pixels;
-      vals[1] = 0;
-      xcb_configure_window(sn.conn, c->frame, masks, vals);
-    }
+      cln_map(c, true);
+  for (c = m->cln; c; c = c->next)
+    if (!INPAGE(c))
+      cln_map(c, false);
 }
 
 void cln_set_tag(client_t *c, uint32_t tag, bool toggle)
 {
   assert(c && "bad call to cln_set_tag");
   client_t *fb;
+  int i;
 
   if (toggle)
     tag ^= c->tag;
@@ -1158,6 +2227,13 @@ void cln_set_tag(client_t *c, uint32_t tag, bool toggle)
     return;
   }
   fb = cln_focus_fallback(c);
+  for (i = 0; i < fm->np; i++)
+    if ((c->tag ^ tag) & LSB(i)) {
+      if (tag & LSB(i))
+        cln_link_page(c, i, NULL);
+      else
+        cln_unlink_page(c, i);
+    }
   c->tag = tag;
   if (!INPAGE(c)) {
     if (c->sel) {
@@ -1165,64 +2241,81 @@ void cln_set_tag(client_t *c, uint32_t tag, bool toggle)
       nsel--;
     }
     cln_show_hide(fm);
-    mon_arrange(fm);
-    cln_set_focus(fb);
+    mon_invalidate(fm, DirtyLayout);
+    mon_refocus(fm, fb);
   }
-  mon_draw_bar(fm);
+  mon_invalidate(fm, DirtyBar);
 }
 
+INLINE
+client_t *first_inpage(monitor_t *m)
+{
+  return m->ph[m->fp];
+}
+
+INLINE
+client_t *last_inpage(monitor_t *m)
+{
+  return m->pt[m->fp];
+}
+
+INLINE
 client_t *next_inpage(client_t *c)
 {
-  for (; c && !INPAGE(c); c = c->next) ;
-  return c;
+  return c->pl[fm->fp].next;
 }
 
+INLINE
 client_t *prev_inpage(client_t *c)
 {
-  client_t *p = next_inpage(fm->cln), *n;
-  for (; p && (n = next_inpage(p->next)) != c; p = n) ;
-  return p;
+  return c->pl[fm->fp].prev;
 }
 
+// first tiled client in page starting from c, which is in page
 client_t *next_tiled(client_t *c)
 {
-  for (; c && (!INPAGE(c) || c->isfloating); c = c->next) ;
+  for (; c && c->isfloating; c = next_inpage(c)) ;
+  return c;
+}
+
+// last tiled client in page up to c, which is in page
+client_t *prev_tiled(client_t *c)
+{
+  for (; c && c->isfloating; c = prev_inpage(c)) ;
   return c;
 }
 
+bool is_tiled_frame(xcb_window_t win)
+{
+  client_t *c = cln_from_frame(win);
+
+  return c && INPAGE(c) && !c->isfloating;
+}
+
+// first client with selected tabs in page starting from c, which is in page
 client_t *next_selected(client_t *c)
 {
-  for (; c && (!INPAGE(c) || c->sel == 0); c = c->next) ;
+  for (; c && c->sel == 0; c = next_inpage(c)) ;
   return c;
 }
 
+INLINE
 client_t *cln_from_tab(xcb_window_t win)
 {
-  client_t *c;
-  int i;
-
-  for (c = fm->cln; c; c = c->next)
-    for (i = 0; i < c->nt; i++)
-      if (c->tab[i] == win)
-        return c;
-  return NULL;
+  return wmap_lookup(win, RoleTab, NULL);
 }
 
+INLINE
 client_t *cln_from_frame(xcb_window_t frame)
 {
-  client_t *c;
-
-  for (c = fm->cln; c; c = c->next)
-    if (c->frame == frame)
-      return c;
-  return NULL;
+  return wmap_lookup(frame, RoleFrame, NULL);
 }
 
 client_t *cln_focus_fallback(client_t *c)
 {
   client_t *fb;
 
-  if (!(fb = next_inpage(c->next)))
+  if (!(fb = next_inpage(c)))
     fb = prev_inpage(c);
   return fb;
 }
@@ -1235,7 +2328,11 @@ void bn_quit(UNUSED const arg_t *arg)
 void bn_spawn(const arg_t *arg)
 {
   char **args = (char **)arg->v;
-  pid_t pid = fork();
+  pid_t pid;
+
+  // whatever the binding changed reaches the server before the program starts
+  flush_urgent();
+  pid = fork();
 
   if (pid == -1) {
     LOGW("fork failed\n")
@@ -1257,17 +2354,16 @@ void bn_kill_tab(UNUSED const arg_t *arg)
     return;
 
   if (nsel > 0) { // consume selection
-    for (c = next_selected(fm->cln); c; c = next_selected(c->next))
+    for (c = next_selected(first_inpage(fm)); c; c = next_selected(next_inpage(c)))
       for (i = 0; i < c->nt; i++) if (c->sel & LSB(i))
-        win_kill(c->tab[i]);
+        win_kill(c->tab[i].win, &c->tab[i].props);
   } else
-    win_kill(fc->tab[fc->ft]);
-  xcb_flush(sn.conn);
+    win_kill(fc->tab[fc->ft].win, &fc->tab[fc->ft].props);
 }
 
 void bn_swap_tab(const arg_t *arg)
 {
-  char buf[VXWM_TAB_NAME_BUF];
+  tab_t t;
   int swp = -1;
 
   if (!fc || fc->nt == 1)
@@ -1293,67 +2389,67 @@ void bn_swap_tab(const arg_t *arg)
       return;
   }
   SWAP_BITS(fc->sel, swp, fc->ft);
-  SWAP(fc->tab[swp], fc->tab[fc->ft])
-  memcpy(buf, fc->name[swp], VXWM_TAB_NAME_BUF);
-  memcpy(fc->name[swp], fc->name[fc->ft], VXWM_TAB_NAME_BUF);
-  memcpy(fc->name[fc->ft], buf, VXWM_TAB_NAME_BUF);
+  t = fc->tab[swp];
+  fc->tab[swp] = fc->tab[fc->ft];
+  fc->tab[fc->ft] = t;
+  wmap_insert(fc->tab[swp].win, fc, RoleTab, swp);
+  wmap_insert(fc->tab[fc->ft].win, fc, RoleTab, fc->ft);
   bn_focus_tab(arg);
 }
 
 void bn_swap_cln(const arg_t *arg)
 {
-  client_t *p = NULL, *c = next_tiled(fm->cln), *pf;
+  client_t *p = NULL, *c, *q, *pf;
 
-  if (!fc || fc->isfloating || !next_tiled(c->next))
+  if (!fc || fc->isfloating || !next_tiled(next_inpage(next_tiled(first_inpage(fm)))))
     return;
 
+  // only the order within the focus page changes
   switch (arg->p) {
     case First:
-      if (next_tiled(fm->cln) == fc)
+      if ((c = next_tiled(first_inpage(fm))) == fc)
         return;
-      c = fm->cln->next;
-      fm->cln->next = fc->next;
-      fc->next = fm->cln;
-      fm->cln = c;
+      // the first tiled client takes the place of the focus client
+      q = prev_inpage(fc);
+      cln_unlink_page(fc, fm->fp);
+      cln_link_page(fc, fm->fp, prev_inpage(c));
+      if (q != c) {
+        cln_unlink_page(c, fm->fp);
+        cln_link_page(c, fm->fp, q);
+      }
+      p = prev_inpage(fc);
       break;
     case Top: // not necessarily a 'swap'
       break;
     case Last:
     case Bottom:
-      if ((p = next_tiled(fc->next)) == NULL)
+      if (next_tiled(next_inpage(fc)) == NULL)
         return;
-      while (next_tiled(p->next))
-        p = next_tiled(p->next);
+      p = prev_tiled(last_inpage(fm));
       break;
     case Prev:
-      if ((c = next_tiled(fm->cln)) == fc) // wrap to last tiled
-        for (p = c, c = NULL; next_tiled(p->next); p = next_tiled(p->next)) ;
-      while (c && next_tiled(c->next) != fc) {
-        p = c;
-        c = next_tiled(c->next);
-      }
+      if ((c = prev_tiled(prev_inpage(fc))) == NULL) // wrap to last tiled
+        p = prev_tiled(last_inpage(fm));
+      else
+        p = prev_tiled(prev_inpage(c));
       break;
     case Next:
-      p = next_tiled(fc->next);
+      p = next_tiled(next_inpage(fc));
       break;
     default:
       assert(false && "bad argument in bn_swap_cln");
       return;
   }
   // reattach focus client
-  cln_detach(fc);
-  if (p) {
-    fc->next = p->next;
-    p->next = fc;
-  } else {
-    fc->next = fm->cln;
-    fm->cln = fc;
+  if (p != fc) {
+    cln_unlink_page(fc, fm->fp);
+    cln_link_page(fc, fm->fp, p);
   }
   // loose focus briefly so that enter notify does not steal focus after arrange
   pf = fc;
   cln_set_focus(NULL);
-  mon_arrange(fm);
-  cln_set_focus(pf);
+  mon_invalidate(fm, DirtyLayout);
+  mon_refocus(fm, pf);
 }
 
 void bn_move_cln(UNUSED const arg_t *arg)
@@ -1384,7 +2480,6 @@ void bn_toggle_select(UNUSED const arg_t *arg)
   fc->sel ^= LSB(fc->ft);
   nsel += (fc->sel & LSB(fc->ft)) ? +1 : -1;
   cln_draw_tabs(fc);
-  xcb_flush(sn.conn);
 }
 
 void bn_toggle_float(UNUSED const arg_t *arg)
@@ -1393,7 +2488,7 @@ void bn_toggle_float(UNUSED const arg_t *arg)
     return;
 
   fc->isfloating = !fc->isfloating;
-  mon_arrange(fm);
+  mon_invalidate(fm, DirtyLayout);
 }
 
 void bn_toggle_fullscr(UNUSED const arg_t *arg)
@@ -1407,15 +2502,13 @@ void bn_toggle_fullscr(UNUSED const arg_t *arg)
     cln_set_fullscr(fc, false);
   fc->isfullscr = !fc->isfullscr;
   cln_set_focus(NULL);
-  mon_arrange(fm);
-  if (fc == NULL)
-    cln_set_focus(pf);
+  mon_invalidate(fm, DirtyLayout);
+  mon_refocus(fm, pf);
 }
 
 void bn_merge_cln(const arg_t *arg)
 {
   client_t *c, *d, *mc;
-  xcb_window_t win;
   int i;
 
   // maximum tab count is capped at 64
@@ -1434,71 +2527,76 @@ void bn_merge_cln(const arg_t *arg)
       cln_attach(mc);
       break;
   }
- 
-  c = next_selected(fm->cln);
-  while (c) {
-    while (c->sel) { // consume selection
-      for (i = 0; !(c->sel & LSB(i)); i++) ;
-      win = c->tab[i];
-      cln_detach_tab(c, win);
-      cln_attach_tab(mc, win);
-      win_set_state(win, XCB_ICCCM_WM_STATE_ICONIC);
+
+  xcb_grab_server(sn.conn);
+  for (c = next_selected(first_inpage(fm)); c; c = d) {
+    d = next_selected(next_inpage(c));
+    if (c == mc) { // selected tabs of the destination stay where they are
+      for (i = 0; i < c->nt; i++)
+        if (c->sel & LSB(i))
+          nsel--;
+      c->sel = 0;
+      continue;
     }
+    cln_transfer_tabs(c, c->sel, mc);
     if (c->nt == 0) {
-      d = c;
-      c = next_selected(c->next);
-      cln_detach(d);  
-      cln_delete(d);
+      cln_detach(c);
+      cln_delete(c);
     } else {
+      cln_sync_tabs(c);
       cln_draw_tabs(c);
-      c = next_selected(c->next);
     }
   }
+  xcb_ungrab_server(sn.conn);
   assert(nsel == 0 && "bad selection counting");
-  win_stack(mc->tab[mc->ft], Top);
-  win_set_state(mc->tab[mc->ft], XCB_ICCCM_WM_STATE_NORMAL);
-  mon_arrange(fm);
-  cln_set_focus(mc);
-  xcb_flush(sn.conn);
+  cln_sync_tabs(mc);
+  mon_invalidate(fm, DirtyLayout);
+  mon_refocus(fm, mc);
 }
 
 void bn_split_cln(UNUSED const arg_t *arg)
 {
   client_t *c, *sc = NULL;
-  xcb_window_t win;
+  uint64_t mask;
   int i;
 
   if (!fc || (nsel == 0 && fc->nt == 1))
     return;
 
+  xcb_grab_server(sn.conn);
   if (nsel == 0) { // split focus tab from focus client
     sc = cln_create();
     cln_attach(sc);
-    win = fc->tab[fc->ft];
-    cln_detach_tab(fc, win);
-    cln_attach_tab(sc, win);
-    win_set_state(fc->tab[fc->ft], XCB_ICCCM_WM_STATE_NORMAL);
-  } else for (c = next_selected(fm->cln); c; c = next_selected(c->next)) {
-    while (c->sel) { // consume selection
-      if (c->nt == 1) {
-        nsel--;
-        c->sel = 0;
-        break;
-      }
+    cln_adopt_tab(sc, &fc->tab[fc->ft]);
+    cln_compact_tabs(fc, LSB(fc->ft));
+    cln_sync_tabs(sc);
+    cln_sync_tabs(fc);
+  } else for (c = next_selected(first_inpage(fm)); c; c = next_selected(next_inpage(c))) {
+    mask = c->sel;
+    for (i = 0; i < c->nt && (mask & LSB(i)); i++) ;
+    if (i == c->nt) // keep one tab behind
+      mask &= mask - 1;
+    // every split tab gets a client of its own, the source is compacted once
+    for (i = 0; i < c->nt; i++) {
+      if (!(mask & LSB(i)))
+        continue;
       sc = cln_create();
       cln_attach(sc);
-      for (i = 0; !(c->sel & LSB(i)); i++) ;
-      win = c->tab[i];
-      cln_detach_tab(c, win);
-      cln_attach_tab(sc, win);
-      win_set_state(win, XCB_ICCCM_WM_STATE_NORMAL);
+      cln_adopt_tab(sc, &c->tab[i]);
+      cln_sync_tabs(sc);
+    }
+    cln_compact_tabs(c, mask);
+    if (c->sel) { // the tab kept behind
+      nsel--;
+      c->sel = 0;
     }
-    win_set_state(c->tab[c->ft], XCB_ICCCM_WM_STATE_NORMAL);
+    cln_sync_tabs(c);
+    cln_draw_tabs(c); // may keep its geometry
   }
+  xcb_ungrab_server(sn.conn);
   assert(nsel == 0 && "bad selection counting");
-  mon_arrange(fm);
-  cln_set_focus(sc ? sc : fc);
-  xcb_flush(sn.conn);
+  mon_invalidate(fm, DirtyLayout);
+  mon_refocus(fm, sc ? sc : fc);
 }
 
 void bn_focus_cln(const arg_t *arg)
@@ -1512,38 +2610,39 @@ void bn_focus_cln(const arg_t *arg)
   switch (arg->p) {
     case Prev:
       if ((c = prev_inpage(fc)) == NULL) // wrap to last in page
-        for (c = fc; next_inpage(c->next); c = next_inpage(c->next)) ;
+        c = last_inpage(fm);
       break;
     case This:
       c = fc;
       break;
     case Next:
-      if ((c = next_inpage(fc->next)) == NULL) // wrap to first in page
-        c = next_inpage(fm->cln);
+      if ((c = next_inpage(fc)) == NULL) // wrap to first in page
+        c = first_inpage(fm);
       break;
     case First:
     case Top:
-      c = next_inpage(fm->cln);
+      c = first_inpage(fm);
       break;
     case Last:
     case Bottom:
-      for (c = fc; next_inpage(c->next); c = next_inpage(c->next)) ;
+      c = last_inpage(fm);
       break;
   }
   cln_set_focus(c);
-  mon_draw_bar(fm);
+  mon_invalidate(fm, DirtyBar);
 }
 
 void bn_focus_tab(const arg_t *arg)
 {
   pos_t p = arg->p;
-  xcb_window_t win, old;
+  xcb_window_t win;
+  UNUSED double t0 = time_ms();
+  UNUSED bool cold;
   int n;
 
   if (!fc)
     return;
 
-  old = fc->tab[fc->ft];
   n = fc->nt;
   switch (p) {
     case First:
@@ -1560,28 +2659,16 @@ void bn_focus_tab(const arg_t *arg)
       fc->ft = (fc->ft + (int)p + n) % n;
       break;
   }
-  win = fc->tab[fc->ft];
+  win = fc->tab[fc->ft].win;
 
-  // since ICCCM does not explicitly define what "IconicState" is,
-  // vxwm considers tabs that are not focused to be "Iconic" since
-  // these tab windows are unviewable but not withdrawn either.
-  if (win != old) {
-    win_set_state(old, XCB_ICCCM_WM_STATE_ICONIC);
-    win_set_state(win, XCB_ICCCM_WM_STATE_NORMAL);
-  }
-
-  // resize tab window to match client dimensions
-  masks = XCB_CONFIG_WINDOW_WIDTH | XCB_CONFIG_WINDOW_HEIGHT;
-  vals[0] = fc->w;
-  vals[1] = fc->h - VXWM_TAB_HEIGHT;
-  xcb_configure_window(sn.conn, win, masks, vals);
-  win_send_configure(win, 0, 0, vals[0], vals[1], 0);
-
-  // raise tab window and redraw client tabs
-  win_stack(win, Top);
-  win_focus(win);
+  // show the sized tab window in place of the others and redraw client tabs,
+  // a cold switch has to resize the tab while the user waits
+  cold = fc->tab[fc->ft].w != fc->w || fc->tab[fc->ft].h != fc->h - VXWM_TAB_HEIGHT;
+  cln_sync_tabs(fc);
+  win_focus(win, &fc->tab[fc->ft].props);
   cln_draw_tabs(fc);
-  LOGI("focusing tab %d (%d/%d)\n", win, fc->ft + 1, fc->nt)
+  LOGI("focusing tab %d (%d/%d) took %.3f ms, %s\n", win, fc->ft + 1, fc->nt,
+       time_ms() - t0, cold ? "cold" : "pre-sized")
 }
 
 void bn_focus_page(const arg_t *arg)
@@ -1592,7 +2679,7 @@ void bn_focus_page(const arg_t *arg)
     return;
   
   // lose selection when switching pages
-  for (c = next_inpage(fm->cln); c; c = next_inpage(c->next))
+  for (c = first_inpage(fm); c; c = next_inpage(c))
     c->sel = 0;
   nsel = 0;
 
@@ -1600,11 +2687,9 @@ void bn_focus_page(const arg_t *arg)
   fm->fp = arg->i;
   cln_show_hide(fm);
   cln_set_focus(NULL);
-  mon_arrange(fm);
+  mon_invalidate(fm, DirtyLayout);
   // TODO: cache the last focused client before switching pages
-  if (fc == NULL)
-    cln_set_focus(next_inpage(fm->cln));
-  mon_draw_bar(fm);
+  mon_refocus(fm, first_inpage(fm));
 }
 
 void bn_toggle_tag(const arg_t *arg)
@@ -1624,15 +2709,13 @@ void bn_set_param(const arg_t *arg)
   int *v = (int *)arg->v;
   
   pages[fm->fp].par[v[0]] += v[1];
-  mon_arrange(fm);
-  mon_draw_bar(fm);
+  mon_invalidate(fm, DirtyLayout);
 }
 
 void bn_set_layout(const arg_t *arg)
 {
   pages[fm->fp].lt = arg->lt;
-  mon_arrange(fm);
-  mon_draw_bar(fm);
+  mon_invalidate(fm, DirtyLayout);
 }
 
 // column layout
@@ -1652,7 +2735,7 @@ void column(const layout_arg_t *arg)
 
   snprintf(m->lt_status, VXWM_LT_STATUS_BUF, "[%d COL]", arg->par[0]);
 
-  for (c = next_tiled(arg->mon->cln), i = 0; c; c = next_tiled(c->next), i++)
+  for (c = next_tiled(first_inpage(m)), i = 0; c; c = next_tiled(next_inpage(c)), i++)
     if (i < cols - 1)
       cln_move_resize(c, m->lx + i * colw, m->ly, colw - BORDER, m->lh - BORDER);
     else
@@ -1680,7 +2763,7 @@ void stack(const layout_arg_t *arg)
 
   snprintf(m->lt_status, VXWM_LT_STATUS_BUF, "[%d/%d STK]", arg->par[0], rn);
 
-  for (c = next_tiled(arg->mon->cln), i = 0; c; c = next_tiled(c->next), i++)
+  for (c = next_tiled(first_inpage(m)), i = 0; c; c = next_tiled(next_inpage(c)), i++)
     if (i < ln)
       cln_move_resize(c, m->lx, m->ly + m->lh / ln * i, lw - BORDER, m->lh / ln - BORDER);
     else
@@ -39,6 +39,7 @@ enum {
   NetWmStateFullscreen,
   NetWmWindowType,
   NetWmWindowTypeDialog,
+  NetClientListStacking,
   NetAtomsCount,
 };
 
@@ -56,6 +57,7 @@ typedef struct monitor monitor_t;
 typedef struct page page_t;
 typedef struct layout_arg layout_arg_t;
 typedef struct client client_t;
+typedef struct tab tab_t;
 typedef struct keybind keybind_t;
 typedef struct btnbind btnbind_t;
 typedef void (*layout_t)(const layout_arg_t *);
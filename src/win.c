@@ -1,130 +1,152 @@
+#include <stdint.h>
 #include <string.h>
 #include <xcb/xcb_icccm.h>
 #include <xcb/xproto.h>
 #include "win.h"
+#include "async.h"
 #include "util.h"
 
-static xcb_get_property_reply_t *win_get_prop(xcb_window_t, xcb_atom_t, xcb_atom_t, int *);
+#define WM_HINTS_INPUT          (1U << 0)
+#define WM_SIZE_HINTS_MIN       (1U << 4)
+#define WM_SIZE_HINTS_MAX       (1U << 5)
 
-// caller is responsible for freeing the return value
-xcb_get_property_reply_t *win_get_prop(xcb_window_t win, xcb_atom_t prop, xcb_atom_t type, int *len)
-{
-  xcb_get_property_cookie_t pc;
-  xcb_get_property_reply_t *pr;
-
-  pc = xcb_get_property(sn.conn, 0, win, prop, type, 0, UINT32_MAX);
-  pr = xcb_get_property_reply(sn.conn, pc, NULL);
-  // TODO: check for errors in reply
-  if (len)
-    *len = xcb_get_property_value_length(pr);
-  return pr;
-}
+static xcb_atom_t win_props_atom(int);
 
-bool win_get_geometry(xcb_window_t win, int *x, int *y, int *w, int *h, int *bw)
+/// Copies a text property reply into a null terminated buffer.
+bool win_text_from_reply(xcb_get_property_reply_t *pr, char *buf, uint32_t buf_len)
 {
-  xcb_get_geometry_cookie_t gc;
-  xcb_get_geometry_reply_t *gr;
+  const char *text;
+  uint32_t len;
 
-  gc = xcb_get_geometry(sn.conn, win);
-  gr = xcb_get_geometry_reply(sn.conn, gc, NULL);
-  if (!gr)
+  if (!buf || buf_len == 0 || !(text = win_text_view(pr, &len)) || len >= buf_len)
     return false;
-  if (x)
-    *x = (int)gr->x;
-  if (y)
-    *y = (int)gr->y;
-  if (w)
-    *w = (int)gr->width;
-  if (h)
-    *h = (int)gr->height;
-  if (bw)
-    *bw = (int)gr->border_width;
-  xfree(gr);
+  memcpy(buf, text, len);
+  buf[len] = '\0';
   return true;
 }
 
-bool win_get_atom_prop(xcb_window_t win, xcb_atom_t prop, xcb_atom_t *reply)
+/// Gives access to a text property in place, without copying it out of the reply.
+/// @return the text, not null terminated, or NULL if the property holds no text
+const char *win_text_view(xcb_get_property_reply_t *pr, uint32_t *len)
 {
-  xcb_get_property_reply_t *pr;
-  xcb_atom_t *atom;
+  if (!pr || pr->format != 8)
+    return NULL;
+  if ((*len = (uint32_t)xcb_get_property_value_length(pr)) == 0)
+    return NULL;
+  return xcb_get_property_value(pr);
+}
 
-  assert(reply);
+/// Requests a text property without waiting, the continuation receives the
+/// raw property reply, read with win_text_view or win_text_from_reply.
+void win_req_text_prop(xcb_window_t win, xcb_atom_t prop, async_fn_t fn, void *data)
+{
+  xcb_get_property_cookie_t pc;
 
-  pr = win_get_prop(win, prop, XCB_ATOM_ATOM, NULL);
-  atom = (xcb_atom_t *)xcb_get_property_value(pr);
-  xfree(pr);
-  if (!atom)
-    return false;
-  *reply = *atom;
-  return true;
+  pc = xcb_icccm_get_text_property(sn.conn, win, prop);
+  async_push(pc.sequence, fn, win, data, NULL);
 }
 
-bool win_get_text_prop(xcb_window_t win, xcb_atom_t prop, char *buf, uint32_t buf_len)
+/// Requests a property without waiting, the continuation receives
+/// the raw property reply and the property atom as its data.
+void win_req_prop(xcb_window_t win, xcb_atom_t prop, async_fn_t fn)
 {
   xcb_get_property_cookie_t pc;
-  xcb_icccm_get_text_property_reply_t tpr;
 
-  if (!buf || buf_len == 0)
-    return false;
-  pc = xcb_icccm_get_text_property(sn.conn, win, prop);
-  if (!xcb_icccm_get_text_property_reply(sn.conn, pc, &tpr, NULL))
-    return false;
-  if (tpr.name_len == 0 || tpr.name_len >= buf_len) {
-    xcb_icccm_get_text_property_reply_wipe(&tpr);
-    return false;
+  pc = xcb_get_property(sn.conn, 0, win, prop, XCB_GET_PROPERTY_TYPE_ANY, 0, UINT32_MAX);
+  async_push(pc.sequence, fn, win, (void *)(uintptr_t)prop, NULL);
+}
+
+xcb_atom_t win_props_atom(int i)
+{
+  switch (i) {
+    case WinPropProtocols:   return sn.wm_atom[WmProtocols];
+    case WinPropHints:       return XCB_ATOM_WM_HINTS;
+    case WinPropNormalHints: return XCB_ATOM_WM_NORMAL_HINTS;
+    case WinPropType:        return sn.net_atom[NetWmWindowType];
   }
-  strncpy(buf, tpr.name, tpr.name_len);
-  buf[tpr.name_len] = '\0';
-  xcb_icccm_get_text_property_reply_wipe(&tpr);
-  LOGV("got %d text property for %d: %s\n", prop, win, buf)
-  return true;
+  return XCB_NONE;
 }
 
-bool win_get_attr(xcb_window_t win, bool *or, uint8_t *ms)
+/// @return the slot of a property in win_props_t, or -1 if it is not cached
+int win_props_index(xcb_atom_t prop)
 {
-  xcb_get_window_attributes_cookie_t wac;
-  xcb_get_window_attributes_reply_t *war;
+  int i;
 
-  wac = xcb_get_window_attributes(sn.conn, win);
-  war = xcb_get_window_attributes_reply(sn.conn, wac, NULL);
+  for (i = 0; i < WinPropsCount && win_props_atom(i) != prop; i++) ;
+  return i < WinPropsCount ? i : -1;
+}
 
-  if (!war)
-    return false;
-  if (or)
-    *or = (bool)war->override_redirect; 
-  if (ms)
-    *ms = war->map_state;
-  xfree(war);
-  return true;
+/// Requests every cached property of a window without waiting.
+void win_props_request(xcb_window_t win, xcb_get_property_cookie_t pc[WinPropsCount])
+{
+  int i;
+
+  for (i = 0; i < WinPropsCount; i++)
+    pc[i] = xcb_get_property(sn.conn, 0, win, win_props_atom(i), XCB_GET_PROPERTY_TYPE_ANY, 0, UINT32_MAX);
 }
 
-bool win_get_state(xcb_window_t win, uint32_t *state)
+/// Collects the replies of win_props_request into a property cache.
+void win_props_reply(xcb_get_property_cookie_t pc[WinPropsCount], win_props_t *props)
 {
   xcb_get_property_reply_t *pr;
-  int len;
-
-  assert(state);
+  int i;
 
-  pr = win_get_prop(win, sn.wm_atom[WmState], sn.wm_atom[WmState], &len);
-  *state = *(uint32_t *)xcb_get_property_value(pr);
-  xfree(pr);
-  return len > 0;
+  for (i = 0; i < WinPropsCount; i++) {
+    pr = xcb_get_property_reply(sn.conn, pc[i], NULL);
+    win_props_update(props, win_props_atom(i), pr);
+    xfree(pr);
+  }
 }
 
-void win_stack(xcb_window_t win, pos_t p)
+/// Refreshes one property in a property cache from its reply,
+/// a missing reply restores the default value of that property.
+void win_props_update(win_props_t *props, xcb_atom_t prop, xcb_get_property_reply_t *pr)
 {
-  uint32_t mask = XCB_CONFIG_WINDOW_STACK_MODE;
-  uint32_t val = p == Top ? XCB_STACK_MODE_ABOVE : XCB_STACK_MODE_BELOW;
-  xcb_configure_window(sn.conn, win, mask, &val);
+  uint32_t *val = NULL;
+  int i, n = 0;
+
+  if (pr && pr->format == 32) {
+    val = (uint32_t *)xcb_get_property_value(pr);
+    n = xcb_get_property_value_length(pr) / 4;
+  }
+  switch (win_props_index(prop)) {
+    case WinPropProtocols:
+      props->proto = 0;
+      for (i = 0; i < n; i++)
+        if (val[i] == sn.wm_atom[WmTakeFocus])
+          props->proto |= LSB(WmTakeFocus);
+        else if (val[i] == sn.wm_atom[WmDeleteWindow])
+          props->proto |= LSB(WmDeleteWindow);
+      break;
+    case WinPropHints: // flags, input, ...
+      props->input = n < 2 || !(val[0] & WM_HINTS_INPUT) || val[1];
+      break;
+    case WinPropNormalHints: // flags, pad[4], min_width, min_height, max_width, max_height, ...
+      props->minw = props->minh = props->maxw = props->maxh = 0;
+      if (n >= 9 && (val[0] & WM_SIZE_HINTS_MIN)) {
+        props->minw = (int)val[5];
+        props->minh = (int)val[6];
+      }
+      if (n >= 9 && (val[0] & WM_SIZE_HINTS_MAX)) {
+        props->maxw = (int)val[7];
+        props->maxh = (int)val[8];
+      }
+      break;
+    case WinPropType:
+      props->type = n > 0 && pr->type == XCB_ATOM_ATOM ? val[0] : XCB_NONE;
+      break;
+  }
 }
 
-/// Sets the input focus window.
+/// Sets the input focus window, props is NULL for windows we do not manage.
 /// If the window supports WM_TAKE_FOCUS protocol, send a client message to it.
-void win_focus(xcb_window_t win)
+/// Windows that declare they take no input are only sent the message.
+void win_focus(xcb_window_t win, const win_props_t *props)
 {
-  if (win != sn.root && win_has_proto(win, sn.wm_atom[WmTakeFocus]))
+  if (props && (props->proto & LSB(WmTakeFocus)))
     win_send_proto(win, sn.wm_atom[WmTakeFocus]);
-  xcb_set_input_focus(sn.conn, XCB_INPUT_FOCUS_POINTER_ROOT, win, XCB_CURRENT_TIME);
+  if (!props || props->input)
+    xcb_set_input_focus(sn.conn, XCB_INPUT_FOCUS_POINTER_ROOT, win, XCB_CURRENT_TIME);
 }
 
 /// Sets the WM_STATE property of a window.
@@ -135,23 +157,6 @@ void win_set_state(xcb_window_t win, uint32_t state)
                       sn.wm_atom[WmState], sn.wm_atom[WmState], 32, 2, data);
 }
 
-/// Queries if a window has a certain WM_PROTOCOL property.
-bool win_has_proto(xcb_window_t win, xcb_atom_t proto)
-{
-  xcb_get_property_cookie_t pc;
-  xcb_icccm_get_wm_protocols_reply_t wmpr;
-  int i, n;
-
-  pc = xcb_icccm_get_wm_protocols(sn.conn, win, sn.wm_atom[WmProtocols]);
-  if (!xcb_icccm_get_wm_protocols_reply(sn.conn, pc, &wmpr, NULL)) {
-    LOGW("failed to retrieve wm protocols for %d\n", win)
-    return false;
-  }
-  for (i = 0, n = wmpr.atoms_len; i < n && wmpr.atoms[i] != proto; i++) ;
-  xcb_icccm_get_wm_protocols_reply_wipe(&wmpr);
-  return i != n;
-}
-
 /// Sends a WM_PROTOCOL client message to a window.
 void win_send_proto(xcb_window_t win, xcb_atom_t proto)
 {
@@ -185,9 +190,9 @@ void win_send_configure(xcb_window_t win, int x, int y, int w, int h, int bw)
 
 /// If the window supports WM_DELETE_WINDOW protocol, send a client message to it.
 /// Otherwise kill it directly from our side.
-void win_kill(xcb_window_t win)
+void win_kill(xcb_window_t win, const win_props_t *props)
 {
-  if (win_has_proto(win, sn.wm_atom[WmDeleteWindow]))
+  if (props->proto & LSB(WmDeleteWindow))
     win_send_proto(win, sn.wm_atom[WmDeleteWindow]);
   else
     xcb_kill_client(sn.conn, win);
@@ -6,18 +6,37 @@
 #include <stdbool.h>
 #include <xcb/xproto.h>
 #include "vxwm.h"
+#include "async.h"
 
-bool win_get_geometry(xcb_window_t, int *, int *, int *, int *, int *);
-bool win_get_atom_prop(xcb_window_t, xcb_atom_t, xcb_atom_t *);
-bool win_get_text_prop(xcb_window_t, xcb_atom_t, char *, uint32_t);
-bool win_get_attr(xcb_window_t, bool *, uint8_t *);
-bool win_get_state(xcb_window_t, uint32_t *);
-void win_stack(xcb_window_t, pos_t);
-void win_focus(xcb_window_t);
+enum {
+  WinPropProtocols = 0,
+  WinPropHints,
+  WinPropNormalHints,
+  WinPropType,
+  WinPropsCount,
+};
+
+// window properties cached per tab, refreshed when the window changes them
+typedef struct win_props {
+  uint32_t proto;      // supported WM_PROTOCOLS, LSB(WmTakeFocus) | LSB(WmDeleteWindow)
+  bool input;          // WM_HINTS input field, true if unset
+  int minw, minh;      // WM_NORMAL_HINTS minimum size, 0 if unset
+  int maxw, maxh;      // WM_NORMAL_HINTS maximum size, 0 if unset
+  xcb_atom_t type;     // first _NET_WM_WINDOW_TYPE, XCB_NONE if unset
+} win_props_t;
+
+bool win_text_from_reply(xcb_get_property_reply_t *, char *, uint32_t);
+const char *win_text_view(xcb_get_property_reply_t *, uint32_t *);
+void win_req_text_prop(xcb_window_t, xcb_atom_t, async_fn_t, void *);
+void win_req_prop(xcb_window_t, xcb_atom_t, async_fn_t);
+int win_props_index(xcb_atom_t);
+void win_props_request(xcb_window_t, xcb_get_property_cookie_t[WinPropsCount]);
+void win_props_reply(xcb_get_property_cookie_t[WinPropsCount], win_props_t *);
+void win_props_update(win_props_t *, xcb_atom_t, xcb_get_property_reply_t *);
+void win_focus(xcb_window_t, const win_props_t *);
 void win_set_state(xcb_window_t, uint32_t);
-bool win_has_proto(xcb_window_t, xcb_atom_t);
 void win_send_proto(xcb_window_t, xcb_atom_t);
 void win_send_configure(xcb_window_t, int, int, int, int, int);
-void win_kill(xcb_window_t);
+void win_kill(xcb_window_t, const win_props_t *);
 
 #endif // VXWM_WIN_H
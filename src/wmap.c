@@ -0,0 +1,113 @@
+#include <stdint.h>
+#include <string.h>
+#include "wmap.h"
+#include "util.h"
+
+#define WMAP_MIN_BITS   6
+#define WMAP_HASH(W)    ((uint32_t)((W) * 2654435769u) >> (32 - bits))
+
+// a slot is vacant when its window is XCB_NONE
+typedef struct entry {
+  xcb_window_t win;    // key, frame or tab window
+  role_t role;         // what the window is to its client
+  int idx;             // tab index, unused for frames
+  client_t *cln;       // owning client
+} entry_t;
+
+static void wmap_grow(void);
+static entry_t *slot;
+static uint32_t bits, cap, cnt;
+
+void wmap_setup(void)
+{
+  bits = WMAP_MIN_BITS;
+  cap = 1U << bits;
+  cnt = 0;
+  slot = xmalloc(sizeof(entry_t) * cap);
+  memset(slot, 0, sizeof(entry_t) * cap);
+}
+
+void wmap_cleanup(void)
+{
+  xfree(slot);
+  slot = NULL;
+  cap = cnt = 0;
+}
+
+// double the capacity and rehash, keeping the load factor at or below one half
+void wmap_grow(void)
+{
+  entry_t *old = slot;
+  uint32_t i, j, n = cap;
+
+  bits++;
+  cap = 1U << bits;
+  slot = xmalloc(sizeof(entry_t) * cap);
+  memset(slot, 0, sizeof(entry_t) * cap);
+  for (i = 0; i < n; i++) {
+    if (old[i].win == XCB_NONE)
+      continue;
+    for (j = WMAP_HASH(old[i].win); slot[j].win != XCB_NONE; j = (j + 1) & (cap - 1)) ;
+    slot[j] = old[i];
+  }
+  xfree(old);
+  LOGV("window map grown to %u slots\n", cap)
+}
+
+/// Maps a window to its client, an existing entry for the window is overwritten.
+void wmap_insert(xcb_window_t win, client_t *c, role_t role, int idx)
+{
+  uint32_t i;
+
+  assert(win != XCB_NONE && "bad call to wmap_insert");
+  if ((cnt + 1) * 2 > cap)
+    wmap_grow();
+  for (i = WMAP_HASH(win); slot[i].win != XCB_NONE && slot[i].win != win; i = (i + 1) & (cap - 1)) ;
+  if (slot[i].win == XCB_NONE)
+    cnt++;
+  slot[i].win = win;
+  slot[i].role = role;
+  slot[i].idx = idx;
+  slot[i].cln = c;
+}
+
+/// Removes a window from the map, shifting back entries of the same probe chain
+/// so that lookups never need tombstones.
+void wmap_remove(xcb_window_t win)
+{
+  uint32_t i, j, h;
+
+  for (i = WMAP_HASH(win); slot[i].win != win; i = (i + 1) & (cap - 1))
+    if (slot[i].win == XCB_NONE)
+      return;
+  cnt--;
+  for (j = (i + 1) & (cap - 1); slot[j].win != XCB_NONE; j = (j + 1) & (cap - 1)) {
+    h = WMAP_HASH(slot[j].win);
+    // move entry j into the hole at i unless its home slot lies cyclically in (i, j]
+    if ((j > i && (h <= i || h > j)) || (j < i && (h <= i && h > j))) {
+      slot[i] = slot[j];
+      i = j;
+    }
+  }
+  slot[i].win = XCB_NONE;
+}
+
+/// Looks up the client owning a window in the given role.
+/// @param idx stores the tab index if the window is a tab
+client_t *wmap_lookup(xcb_window_t win, role_t role, int *idx)
+{
+  uint32_t i;
+
+  if (win == XCB_NONE || !slot)
+    return NULL;
+  for (i = WMAP_HASH(win); slot[i].win != win; i = (i + 1) & (cap - 1))
+    if (slot[i].win == XCB_NONE)
+      return NULL;
+  if (slot[i].role != role)
+    return NULL;
+  if (idx)
+    *idx = slot[i].idx;
+  return slot[i].cln;
+}
+
+// vim: ts=2:sw=2:et
@@ -0,0 +1,22 @@
+#ifndef VXWM_WMAP_H
+#define VXWM_WMAP_H
+
+// WINDOW LOOKUP TABLE
+//   open addressing hash map from X window ids to clients
+//   resolves both client frames and tab windows in constant time
+
+#include <xcb/xproto.h>
+#include "vxwm.h"
+
+typedef enum {
+  RoleFrame = 0,
+  RoleTab,
+} role_t;
+
+void wmap_setup(void);
+void wmap_cleanup(void);
+void wmap_insert(xcb_window_t, client_t *, role_t, int);
+void wmap_remove(xcb_window_t);
+client_t *wmap_lookup(xcb_window_t, role_t, int *);
+
+#endif // VXWM_WMAP_H